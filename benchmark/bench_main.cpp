@@ -0,0 +1,228 @@
+#include "corpus_generator.h"
+#include "search_server.h"
+#include "process_queries.h"
+#include "remove_duplicates.h"
+#include "metrics.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+using namespace std::literals;
+
+namespace {
+
+struct BenchmarkResult {
+    std::string name;
+    // Operations timed one by one, a batch counts all its items
+    size_t operations = 0;
+    double seconds = 0.0;
+    std::vector<double> latencies_us;
+    size_t peak_rss_bytes = 0;
+};
+
+size_t GetPeakRssBytes() {
+#ifndef _WIN32
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+    return 0;
+#endif
+}
+
+// Nearest-rank percentile of sorted latencies
+double GetPercentile(const std::vector<double>& sorted, double share) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    const size_t rank = static_cast<size_t>(std::ceil(share * static_cast<double>(sorted.size())));
+    return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+// Calls operation(i) for i in [0, count) and times every call, items_per_call counts the work of one call
+template <typename Operation>
+BenchmarkResult Measure(const std::string& name, size_t count, size_t items_per_call, Operation operation) {
+    using Clock = std::chrono::steady_clock;
+    BenchmarkResult result;
+    result.name = name;
+    result.operations = count * items_per_call;
+    result.latencies_us.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        const auto start = Clock::now();
+        operation(i);
+        const std::chrono::duration<double> duration = Clock::now() - start;
+        result.seconds += duration.count();
+        result.latencies_us.push_back(duration.count() * 1e6);
+    }
+    std::sort(result.latencies_us.begin(), result.latencies_us.end());
+    result.peak_rss_bytes = GetPeakRssBytes();
+    return result;
+}
+
+void PrintJson(const CorpusOptions& options, const std::vector<BenchmarkResult>& results, std::ostream& out) {
+    out << std::fixed << std::setprecision(3);
+    out << "{\n"s;
+    out << "  \"corpus\": {\"seed\": "s << options.seed << ", \"documents\": "s << options.document_count
+        << ", \"document_length\": "s << options.document_length << ", \"vocabulary\": "s << options.vocabulary_size
+        << ", \"zipf_exponent\": "s << options.zipf_exponent << ", \"queries\": "s << options.query_count
+        << ", \"query_length\": "s << options.query_length << "},\n"s;
+    out << "  \"benchmarks\": [\n"s;
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult& result = results[i];
+        const double throughput = result.seconds > 0.0 ? static_cast<double>(result.operations) / result.seconds : 0.0;
+        out << "    {\"name\": \""s << result.name << "\", \"operations\": "s << result.operations
+            << ", \"seconds\": "s << result.seconds << ", \"throughput_per_second\": "s << throughput
+            << ", \"p50_us\": "s << GetPercentile(result.latencies_us, 0.5)
+            << ", \"p99_us\": "s << GetPercentile(result.latencies_us, 0.99)
+            << ", \"peak_rss_bytes\": "s << result.peak_rss_bytes << "}"s
+            << (i + 1 < results.size() ? ",\n"s : "\n"s);
+    }
+    out << "  ],\n"s;
+    out << "  \"peak_rss_bytes\": "s << GetPeakRssBytes() << ",\n"s;
+    out << "  \"metrics\": "s << GetMetrics().Export(MetricsFormat::JSON) << "\n"s;
+    out << "}"s << std::endl;
+}
+
+void PrintUsage() {
+    std::cerr << "Usage: search_server_bench [--seed N] [--documents N] [--length N] [--vocabulary N]"s
+              << " [--zipf X] [--queries N] [--query-length N]"s << std::endl;
+}
+
+// Options come as "--name value" pairs, false for anything else
+bool ParseOptions(int argc, char* argv[], CorpusOptions& options) {
+    for (int i = 1; i < argc; i += 2) {
+        const std::string name = argv[i];
+        if (i + 1 >= argc) {
+            return false;
+        }
+        const char* value = argv[i + 1];
+        if (name == "--seed"s) {
+            options.seed = std::strtoull(value, nullptr, 10);
+        } else if (name == "--documents"s) {
+            options.document_count = std::strtoull(value, nullptr, 10);
+        } else if (name == "--length"s) {
+            options.document_length = std::strtoull(value, nullptr, 10);
+        } else if (name == "--vocabulary"s) {
+            options.vocabulary_size = std::strtoull(value, nullptr, 10);
+        } else if (name == "--zipf"s) {
+            options.zipf_exponent = std::strtod(value, nullptr);
+        } else if (name == "--queries"s) {
+            options.query_count = std::strtoull(value, nullptr, 10);
+        } else if (name == "--query-length"s) {
+            options.query_length = std::strtoull(value, nullptr, 10);
+        } else {
+            return false;
+        }
+    }
+    return options.query_length > 0;
+}
+
+}  // namespace
+
+// Runs every benchmark on one seeded corpus and prints the results as JSON to stdout
+int main(int argc, char* argv[]) {
+    CorpusOptions options;
+    if (!ParseOptions(argc, argv, options)) {
+        PrintUsage();
+        return 1;
+    }
+    CorpusGenerator generator(options);
+    const std::vector<std::string> documents = generator.GenerateDocuments();
+    const std::vector<std::string> queries = generator.GenerateQueries();
+    const size_t document_count = documents.size();
+    const size_t query_count = queries.size();
+
+    std::vector<BenchmarkResult> results;
+    SearchServer server(""s);
+    results.push_back(Measure("AddDocument"s, document_count, 1, [&](size_t i) {
+        server.AddDocument(static_cast<int>(i), documents[i], DocumentStatus::ACTUAL, {static_cast<int>(i % 10)});
+    }));
+    server.WaitForMerges();
+
+    size_t found_count = 0;
+    results.push_back(Measure("FindTopDocuments/seq"s, query_count, 1, [&](size_t i) {
+        found_count += server.FindTopDocuments(queries[i]).size();
+    }));
+    // The same searches without instrumentation show what the metrics cost
+    GetMetrics().SetEnabled(false);
+    results.push_back(Measure("FindTopDocuments/seq/no-metrics"s, query_count, 1, [&](size_t i) {
+        found_count += server.FindTopDocuments(queries[i]).size();
+    }));
+    GetMetrics().SetEnabled(true);
+    results.push_back(Measure("FindTopDocuments/par"s, query_count, 1, [&](size_t i) {
+        found_count += server.FindTopDocuments(std::execution::par, queries[i]).size();
+    }));
+    // Every page continues from the last document of the previous one, the cost should not grow with depth
+    const size_t page_count = query_count > 0 ? 50 : 0;
+    std::optional<Document> after;
+    results.push_back(Measure("FindTopDocumentsAfter/pages"s, page_count, 1, [&](size_t) {
+        const std::vector<Document> page = server.FindTopDocumentsAfter(queries.front(), DocumentStatus::ACTUAL, after,
+                                                                        MAX_RESULT_DOCUMENT_COUNT);
+        after = page.empty() ? after : page.back();
+        found_count += page.size();
+    }));
+    if (document_count > 0) {
+        results.push_back(Measure("MatchDocument"s, query_count, 1, [&](size_t i) {
+            found_count += std::get<0>(server.MatchDocument(queries[i], static_cast<int>(i * 7919 % document_count))).size();
+        }));
+    }
+    const size_t batch_runs = 5;
+    results.push_back(Measure("ProcessQueries"s, batch_runs, query_count, [&](size_t) {
+        found_count += ProcessQueries(server, queries).size();
+    }));
+
+    // Changes go to forks, every benchmark starts from the same index
+    SearchServer deduplicated = server.Fork();
+    results.push_back(Measure("RemoveDuplicates"s, 1, document_count, [&](size_t) {
+        // Found duplicates are reported to std::cout, which carries the JSON
+        std::ostringstream discarded;
+        std::streambuf* const output = std::cout.rdbuf(discarded.rdbuf());
+        RemoveDuplicates(deduplicated);
+        std::cout.rdbuf(output);
+    }));
+    SearchServer removed = server.Fork();
+    const size_t remove_count = document_count / 10;
+    results.push_back(Measure("RemoveDocument"s, remove_count, 1, [&](size_t i) {
+        removed.RemoveDocument(static_cast<int>(i * 10));
+    }));
+
+    // Prefixes are the first three letters of the first word of every query, which is never a minus word
+    std::vector<std::string> prefix_queries;
+    for (const std::string& query : queries) {
+        prefix_queries.push_back(query.substr(0, std::min<size_t>(3, query.find(' '))) + '*');
+    }
+    results.push_back(Measure("FindTopDocuments/prefix"s, prefix_queries.size(), 1, [&](size_t i) {
+        found_count += server.FindTopDocuments(prefix_queries[i]).size();
+    }));
+
+    // Phrases are pairs of neighbouring words taken from documents, so every one of them is found
+    SearchServer positional = server.Fork();
+    positional.SetPositionalIndex(true);
+    std::vector<std::string> phrase_queries;
+    for (size_t i = 0; i < query_count && document_count > 0; ++i) {
+        const std::string& text = documents[i * 7919 % document_count];
+        const size_t first_space = text.find(' ');
+        const size_t second_space = text.find(' ', first_space == std::string::npos ? text.size() : first_space + 1);
+        phrase_queries.push_back('"' + text.substr(0, second_space) + '"');
+    }
+    results.push_back(Measure("FindTopDocuments/phrase"s, phrase_queries.size(), 1, [&](size_t i) {
+        found_count += positional.FindTopDocuments(phrase_queries[i]).size();
+    }));
+
+    PrintJson(generator.GetOptions(), results, std::cout);
+    // Keeps the searches from being optimized away
+    return found_count == static_cast<size_t>(-1) ? 1 : 0;
+}
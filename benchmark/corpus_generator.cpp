@@ -0,0 +1,79 @@
+#include "corpus_generator.h"
+#include <algorithm>
+#include <cmath>
+
+CorpusGenerator::CorpusGenerator(const CorpusOptions& options)
+        : options_(options)
+        , generator_(options.seed) {
+    options_.vocabulary_size = std::max<size_t>(options_.vocabulary_size, 1);
+    rank_cdf_.reserve(options_.vocabulary_size);
+    double sum = 0.0;
+    for (size_t rank = 1; rank <= options_.vocabulary_size; ++rank) {
+        sum += 1.0 / std::pow(static_cast<double>(rank), options_.zipf_exponent);
+        rank_cdf_.push_back(sum);
+    }
+    for (double& probability : rank_cdf_) {
+        probability /= sum;
+    }
+}
+
+std::vector<std::string> CorpusGenerator::GenerateDocuments() {
+    std::vector<std::string> documents;
+    documents.reserve(options_.document_count);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    for (size_t i = 0; i < options_.document_count; ++i) {
+        if (!documents.empty() && chance(generator_) < 0.01) {
+            std::uniform_int_distribution<size_t> earlier(0, documents.size() - 1);
+            documents.push_back(documents[earlier(generator_)]);
+        } else {
+            documents.push_back(GenerateText(options_.document_length));
+        }
+    }
+    return documents;
+}
+
+std::vector<std::string> CorpusGenerator::GenerateQueries() {
+    std::vector<std::string> queries;
+    queries.reserve(options_.query_count);
+    std::uniform_real_distribution<double> chance(0.0, 1.0);
+    for (size_t i = 0; i < options_.query_count; ++i) {
+        std::string query = GenerateText(options_.query_length);
+        // The first word stays a plus word, so every query can find something
+        for (size_t position = query.find(' '); position != std::string::npos; position = query.find(' ', position + 1)) {
+            if (chance(generator_) < options_.minus_word_share) {
+                query.insert(position + 1, 1, '-');
+            }
+        }
+        queries.push_back(std::move(query));
+    }
+    return queries;
+}
+
+const CorpusOptions& CorpusGenerator::GetOptions() const {
+    return options_;
+}
+
+std::string CorpusGenerator::GenerateText(size_t length) {
+    std::uniform_real_distribution<double> probability(0.0, 1.0);
+    std::string text;
+    for (size_t i = 0; i < length; ++i) {
+        const double value = probability(generator_);
+        const size_t rank = std::min<size_t>(std::lower_bound(rank_cdf_.begin(), rank_cdf_.end(), value) - rank_cdf_.begin(),
+                                             rank_cdf_.size() - 1);
+        if (!text.empty()) {
+            text += ' ';
+        }
+        text += MakeWord(rank);
+    }
+    return text;
+}
+
+std::string CorpusGenerator::MakeWord(size_t rank) {
+    // Frequent words get short names, like in natural text
+    std::string word;
+    do {
+        word += static_cast<char>('a' + rank % 26);
+        rank /= 26;
+    } while (rank > 0);
+    return word;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <vector>
+
+struct CorpusOptions {
+    uint64_t seed = 42;
+    size_t document_count = 20000;
+    // Number of words of every document
+    size_t document_length = 64;
+    size_t vocabulary_size = 50000;
+    // Word of rank r is drawn with probability proportional to 1 / r^zipf_exponent
+    double zipf_exponent = 1.0;
+    size_t query_count = 2000;
+    size_t query_length = 4;
+    // Share of query words turned into minus words
+    double minus_word_share = 0.1;
+};
+
+// Synthetic documents and queries over a Zipfian vocabulary. The same options give the same corpus
+// on every run, so versions of the server are compared on equal input.
+class CorpusGenerator {
+public:
+    explicit CorpusGenerator(const CorpusOptions& options);
+
+    // Every document has its own text, a few of them repeat an earlier one to give RemoveDuplicates work
+    std::vector<std::string> GenerateDocuments();
+
+    std::vector<std::string> GenerateQueries();
+
+    const CorpusOptions& GetOptions() const;
+
+private:
+    CorpusOptions options_;
+    std::mt19937_64 generator_;
+    // Cumulative probabilities of word ranks
+    std::vector<double> rank_cdf_;
+
+    std::string GenerateText(size_t length);
+
+    static std::string MakeWord(size_t rank);
+};
@@ -1,8 +1,16 @@
 #pragma once
-#include <future>
+#include <algorithm>
+#include <cstdint>
+#include <execution>
 #include <map>
+#include <mutex>
+#include <numeric>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+// Hash map split into independently locked shards. Every shard is an open-addressing table
+// with linear probing and sits on its own cache lines together with its mutex.
 template <typename Key, typename Value>
 class ConcurrentMap {
 public:
@@ -13,34 +21,168 @@ public:
         Value& ref_to_value;
     };
 
-    explicit ConcurrentMap(size_t bucket_count) : buck_C(bucket_count), m_(uint64_t(bucket_count)) {
-        for (size_t i = 0 ; i < bucket_count ; ++i) {
-            concurrent_maps_[i];
-        }
+    explicit ConcurrentMap(size_t bucket_count) : shards_(std::max<size_t>(bucket_count, 1)) {
     };
 
     Access operator[](const Key& key) {
-        auto partToLock = key % buck_C;
-        return {std::lock_guard<std::mutex>(m_[partToLock]), concurrent_maps_[partToLock][key]};
+        const uint64_t hash = Hash(key);
+        Shard& shard = shards_[ShardIndex(hash)];
+        return {std::lock_guard<std::mutex>(shard.mutex), shard.FindOrInsert(key, hash)};
     };
 
+    void Add(const Key& key, const Value& delta) {
+        static_assert(std::is_arithmetic_v<Value>, "Add requires an arithmetic value type");
+        const uint64_t hash = Hash(key);
+        Shard& shard = shards_[ShardIndex(hash)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.FindOrInsert(key, hash) += delta;
+    }
+
     void Erase(const Key& key) {
-        auto partToLock = key % buck_C;
-        std::lock_guard<std::mutex> lock(m_[partToLock]);
-        concurrent_maps_[partToLock].erase(key);
+        const uint64_t hash = Hash(key);
+        Shard& shard = shards_[ShardIndex(hash)];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.Erase(key, hash);
     }
 
-    std::map<Key, Value> BuildOrdinaryMap() {
-        std::map<Key, Value> ordinaryMap;
-        for (size_t i = 0 ; i < buck_C ; ++i) {
-            std::lock_guard<std::mutex> a (m_[i]);
-            ordinaryMap.insert(concurrent_maps_[i].begin(), concurrent_maps_[i].end());
+    // Copies the shards in parallel and returns all entries ordered by key
+    std::vector<std::pair<Key, Value>> BuildSortedVector() {
+        std::vector<std::vector<std::pair<Key, Value>>> parts(shards_.size());
+        std::vector<size_t> indexes(shards_.size());
+        std::iota(indexes.begin(), indexes.end(), 0);
+        std::for_each(std::execution::par,
+                      indexes.begin(),
+                      indexes.end(),
+                      [&](size_t i) {
+                          Shard& shard = shards_[i];
+                          std::lock_guard<std::mutex> lock(shard.mutex);
+                          parts[i].reserve(shard.size);
+                          for (size_t slot = 0; slot < shard.used.size(); ++slot) {
+                              if (shard.used[slot]) {
+                                  parts[i].emplace_back(shard.keys[slot], shard.values[slot]);
+                              }
+                          }
+                      });
+
+        std::vector<std::pair<Key, Value>> result;
+        result.reserve(std::accumulate(parts.begin(), parts.end(), size_t{0},
+                                       [](size_t sum, const auto& part) {
+                                           return sum + part.size();
+                                       }));
+        for (auto& part : parts) {
+            result.insert(result.end(), part.begin(), part.end());
         }
-        return ordinaryMap;
+        std::sort(std::execution::par, result.begin(), result.end(),
+                  [](const auto& lhs, const auto& rhs) {
+                      return lhs.first < rhs.first;
+                  });
+        return result;
+    }
+
+    std::map<Key, Value> BuildOrdinaryMap() {
+        const auto entries = BuildSortedVector();
+        return std::map<Key, Value>(entries.begin(), entries.end());
     };
 
 private:
-    uint64_t buck_C;
-    std::vector<std::mutex> m_;
-    std::map<Key, std::map<Key, Value>> concurrent_maps_;
-};
\ No newline at end of file
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+    static constexpr size_t MIN_CAPACITY = 16;
+
+    struct alignas(CACHE_LINE_SIZE) Shard {
+        std::mutex mutex;
+        std::vector<Key> keys;
+        std::vector<Value> values;
+        std::vector<uint8_t> used;
+        size_t size = 0;
+
+        size_t Mask() const {
+            return used.size() - 1;
+        }
+
+        Value& FindOrInsert(const Key& key, uint64_t hash) {
+            if ((size + 1) * 2 > used.size()) {
+                Grow();
+            }
+            size_t slot = hash & Mask();
+            while (used[slot]) {
+                if (keys[slot] == key) {
+                    return values[slot];
+                }
+                slot = (slot + 1) & Mask();
+            }
+            used[slot] = 1;
+            keys[slot] = key;
+            values[slot] = Value();
+            ++size;
+            return values[slot];
+        }
+
+        void Erase(const Key& key, uint64_t hash) {
+            if (used.empty()) {
+                return;
+            }
+            size_t slot = hash & Mask();
+            while (used[slot] && keys[slot] != key) {
+                slot = (slot + 1) & Mask();
+            }
+            if (!used[slot]) {
+                return;
+            }
+            // Backward shift deletion keeps probe chains intact without tombstones
+            used[slot] = 0;
+            --size;
+            size_t next = slot;
+            while (true) {
+                next = (next + 1) & Mask();
+                if (!used[next]) {
+                    break;
+                }
+                const size_t home = Hash(keys[next]) & Mask();
+                const bool movable = slot <= next ? (home <= slot || home > next)
+                                                  : (home <= slot && home > next);
+                if (movable) {
+                    keys[slot] = keys[next];
+                    values[slot] = std::move(values[next]);
+                    used[slot] = 1;
+                    used[next] = 0;
+                    slot = next;
+                }
+            }
+        }
+
+        void Grow() {
+            const size_t capacity = std::max(MIN_CAPACITY, used.size() * 2);
+            std::vector<Key> old_keys(capacity);
+            std::vector<Value> old_values(capacity);
+            std::vector<uint8_t> old_used(capacity, 0);
+            old_keys.swap(keys);
+            old_values.swap(values);
+            old_used.swap(used);
+            for (size_t i = 0; i < old_used.size(); ++i) {
+                if (old_used[i]) {
+                    size_t slot = Hash(old_keys[i]) & Mask();
+                    while (used[slot]) {
+                        slot = (slot + 1) & Mask();
+                    }
+                    used[slot] = 1;
+                    keys[slot] = old_keys[i];
+                    values[slot] = std::move(old_values[i]);
+                }
+            }
+        }
+    };
+
+    std::vector<Shard> shards_;
+
+    // splitmix64 finalizer, spreads sequential keys over both shards and slots
+    static uint64_t Hash(const Key& key) {
+        uint64_t hash = static_cast<uint64_t>(key) + 0x9E3779B97F4A7C15ull;
+        hash = (hash ^ (hash >> 30)) * 0xBF58476D1CE4E5B9ull;
+        hash = (hash ^ (hash >> 27)) * 0x94D049BB133111EBull;
+        return hash ^ (hash >> 31);
+    }
+
+    size_t ShardIndex(uint64_t hash) const {
+        return (hash >> 32) % shards_.size();
+    }
+};
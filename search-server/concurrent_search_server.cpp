@@ -0,0 +1,32 @@
+#include "concurrent_search_server.h"
+
+ConcurrentSearchServer::ConcurrentSearchServer(SearchServer&& server)
+        : current_(std::make_shared<const SearchServer>(std::move(server))) {
+}
+
+std::shared_ptr<const SearchServer> ConcurrentSearchServer::GetSnapshot() const {
+    return std::atomic_load(&current_);
+}
+
+void ConcurrentSearchServer::AddDocument(int document_id, const std::string_view& document, DocumentStatus status,
+                                         const std::vector<int>& ratings) {
+    Update([&](SearchServer& server) {
+        server.AddDocument(document_id, document, status, ratings);
+    });
+}
+
+void ConcurrentSearchServer::AddDocuments(const std::vector<SearchServer::NewDocument>& documents) {
+    Update([&](SearchServer& server) {
+        server.AddDocuments(documents);
+    });
+}
+
+void ConcurrentSearchServer::RemoveDocument(int document_id) {
+    Update([document_id](SearchServer& server) {
+        server.RemoveDocument(document_id);
+    });
+}
+
+size_t ConcurrentSearchServer::GetDocumentCount() const {
+    return GetSnapshot()->GetDocumentCount();
+}
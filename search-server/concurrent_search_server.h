@@ -0,0 +1,74 @@
+#pragma once
+#include "search_server.h"
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <utility>
+
+// Search server answering queries while documents are added and removed.
+// Readers work on an immutable version of the server and never wait for writers. A writer makes its changes
+// on a fork of the current version and publishes the fork atomically once it is complete, readers that
+// started earlier finish on the version they took. A version is freed when the last reader holding it lets it go.
+// A fork shares the pages of the current version and copies its mutable segment, so a write costs the pages
+// it changes and a copy of up to SegmentOptions::max_mutable_postings postings.
+class ConcurrentSearchServer {
+public:
+    template <typename StopWords>
+    explicit ConcurrentSearchServer(const StopWords& stop_words);
+
+    explicit ConcurrentSearchServer(SearchServer&& server);
+
+    // Current version, it stays valid and unchanged while the pointer is held
+    std::shared_ptr<const SearchServer> GetSnapshot() const;
+
+    // Readers see the changes made by function all at once, a batch of changes costs one fork.
+    // If function throws, nothing is published.
+    template <typename Function>
+    void Update(Function function);
+
+    void AddDocument(int document_id, const std::string_view& document, DocumentStatus status,
+                     const std::vector<int>& ratings);
+
+    void AddDocuments(const std::vector<SearchServer::NewDocument>& documents);
+
+    void RemoveDocument(int document_id);
+
+    // Queries take the same arguments as in SearchServer and are answered by the version current at the call
+    template <typename... Args>
+    std::vector<Document> FindTopDocuments(Args&&... args) const;
+
+    // Words are copied out of the version, which may be freed as soon as the call returns
+    template <typename... Args>
+    std::tuple<std::vector<std::string>, DocumentStatus> MatchDocument(Args&&... args) const;
+
+    size_t GetDocumentCount() const;
+
+private:
+    std::shared_ptr<const SearchServer> current_;
+    std::mutex write_mutex_;
+};
+
+template <typename StopWords>
+ConcurrentSearchServer::ConcurrentSearchServer(const StopWords& stop_words)
+        : ConcurrentSearchServer(SearchServer(stop_words)) {
+}
+
+template <typename Function>
+void ConcurrentSearchServer::Update(Function function) {
+    std::lock_guard<std::mutex> lock(write_mutex_);
+    auto next = std::make_shared<SearchServer>(GetSnapshot()->Fork());
+    function(*next);
+    std::atomic_store(&current_, std::shared_ptr<const SearchServer>(std::move(next)));
+}
+
+template <typename... Args>
+std::vector<Document> ConcurrentSearchServer::FindTopDocuments(Args&&... args) const {
+    return GetSnapshot()->FindTopDocuments(std::forward<Args>(args)...);
+}
+
+template <typename... Args>
+std::tuple<std::vector<std::string>, DocumentStatus> ConcurrentSearchServer::MatchDocument(Args&&... args) const {
+    const auto [words, status] = GetSnapshot()->MatchDocument(std::forward<Args>(args)...);
+    return {std::vector<std::string>(words.begin(), words.end()), status};
+}
@@ -0,0 +1,22 @@
+#include "document_bitmap.h"
+
+void DocumentBitmap::Insert(int document_id) {
+    Page& page = pages_.GetMutable(static_cast<size_t>(document_id) >> PAGE_BITS);
+    const size_t offset = document_id & (PAGE_SIZE - 1);
+    page[offset / 64] |= uint64_t{1} << (offset % 64);
+}
+
+void DocumentBitmap::Erase(int document_id) {
+    const size_t page_index = static_cast<size_t>(document_id) >> PAGE_BITS;
+    if (pages_.Find(page_index) == nullptr) {
+        return;
+    }
+    const size_t offset = document_id & (PAGE_SIZE - 1);
+    pages_.GetMutable(page_index)[offset / 64] &= ~(uint64_t{1} << (offset % 64));
+}
+
+size_t DocumentBitmap::GetMemoryBytes() const {
+    return pages_.GetMemoryBytes([](const Page&) {
+        return size_t{0};
+    });
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "memory_stats.h"
+#include "shared_pages.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Set of document ids kept as bits. Bits live in pages allocated on first insertion,
+// so a sparse id costs one page rather than a bit for every smaller id. Copies share the pages they did not change.
+class DocumentBitmap {
+public:
+    static constexpr int PAGE_BITS = 12;
+    static constexpr int PAGE_SIZE = 1 << PAGE_BITS;
+
+    void Insert(int document_id);
+
+    void Erase(int document_id);
+
+    bool Contains(int document_id) const {
+        const Page* page = pages_.Find(static_cast<size_t>(document_id) >> PAGE_BITS);
+        if (page == nullptr) {
+            return false;
+        }
+        const size_t offset = document_id & (PAGE_SIZE - 1);
+        return ((*page)[offset / 64] >> (offset % 64)) & 1;
+    }
+
+    size_t GetMemoryBytes() const;
+
+private:
+    using Page = std::array<uint64_t, PAGE_SIZE / 64>;
+
+    SharedPages<Page> pages_;
+};
@@ -0,0 +1,50 @@
+#pragma once
+#include "shared_pages.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Number of words of every document, stop words excluded, by document id. Postings keep occurrences only,
+// the term frequency divides them by the length kept here once per document. Pages of 2^PAGE_BITS ids are
+// shared between copies, see SharedPages.
+class DocumentLengths {
+public:
+    static constexpr int PAGE_BITS = 10;
+    static constexpr size_t PAGE_SIZE = size_t{1} << PAGE_BITS;
+
+    // 0 for a document without a length
+    int Get(int document_id) const {
+        const Page* page = pages_.Find(static_cast<size_t>(document_id) >> PAGE_BITS);
+        return page == nullptr ? 0 : static_cast<int>((*page)[document_id & (PAGE_SIZE - 1)]);
+    }
+
+    // Lengths of count documents with ascending ids, a page is looked up once for all its ids
+    void Get(const int* document_ids, size_t count, uint32_t* lengths) const {
+        const Page* page = nullptr;
+        size_t page_index = SIZE_MAX;
+        for (size_t i = 0; i < count; ++i) {
+            const size_t index = static_cast<size_t>(document_ids[i]) >> PAGE_BITS;
+            if (index != page_index) {
+                page = pages_.Find(index);
+                page_index = index;
+            }
+            lengths[i] = page == nullptr ? 0 : (*page)[document_ids[i] & (PAGE_SIZE - 1)];
+        }
+    }
+
+    void Set(int document_id, int length) {
+        pages_.GetMutable(static_cast<size_t>(document_id) >> PAGE_BITS)[document_id & (PAGE_SIZE - 1)] =
+                static_cast<uint32_t>(length);
+    }
+
+    size_t GetMemoryBytes() const {
+        return pages_.GetMemoryBytes([](const Page&) {
+            return size_t{0};
+        });
+    }
+
+private:
+    using Page = std::array<uint32_t, PAGE_SIZE>;
+
+    SharedPages<Page> pages_;
+};
@@ -0,0 +1,85 @@
+#include "forward_index.h"
+#include <cstddef>
+
+void ForwardIndex::Add(int document_id, int document_length, const std::vector<ForwardEntry>& entries) {
+    Page& page = pages_.GetMutable(static_cast<size_t>(document_id) >> PAGE_BITS);
+    const DocumentWords words = {page.entries.size(), static_cast<int>(entries.size()), document_length};
+    page.entries.insert(page.entries.end(), entries.begin(), entries.end());
+    const auto it = LowerBoundId(page.documents, document_id);
+    if (it != page.documents.end() && it->first == document_id) {
+        page.hole_size += it->second.count;
+        it->second = words;
+    } else {
+        page.documents.emplace(it, document_id, words);
+    }
+}
+
+void ForwardIndex::Remove(int document_id) {
+    if (Find(document_id) == nullptr) {
+        return;
+    }
+    Page& page = pages_.GetMutable(static_cast<size_t>(document_id) >> PAGE_BITS);
+    const auto it = LowerBoundId(page.documents, document_id);
+    page.hole_size += it->second.count;
+    page.documents.erase(it);
+    if (page.hole_size * 2 > page.entries.size()) {
+        page.Squeeze();
+    }
+}
+
+bool ForwardIndex::Contains(int document_id) const {
+    return Find(document_id) != nullptr;
+}
+
+std::pair<const ForwardEntry*, const ForwardEntry*> ForwardIndex::GetWords(int document_id) const {
+    const Page* page = pages_.Find(static_cast<size_t>(document_id) >> PAGE_BITS);
+    const DocumentWords* words = page == nullptr ? nullptr : page->Find(document_id);
+    if (words == nullptr) {
+        return {nullptr, nullptr};
+    }
+    const ForwardEntry* first = page->entries.data() + words->offset;
+    return {first, first + words->count};
+}
+
+int ForwardIndex::GetDocumentLength(int document_id) const {
+    const DocumentWords* words = Find(document_id);
+    return words == nullptr ? 0 : words->length;
+}
+
+void ForwardIndex::RenumberWords(const std::vector<int>& new_word_ids) {
+    for (size_t position = 0; position < pages_.GetPageCount(); ++position) {
+        Page& page = pages_.GetMutablePage(position);
+        page.Squeeze();
+        for (ForwardEntry& entry : page.entries) {
+            entry.word_id = new_word_ids[entry.word_id];
+        }
+    }
+}
+
+size_t ForwardIndex::GetMemoryBytes() const {
+    return pages_.GetMemoryBytes([](const Page& page) {
+        return EstimateVectorBytes(page.entries) + EstimateVectorBytes(page.documents);
+    });
+}
+
+const ForwardIndex::DocumentWords* ForwardIndex::Find(int document_id) const {
+    const Page* page = pages_.Find(static_cast<size_t>(document_id) >> PAGE_BITS);
+    return page == nullptr ? nullptr : page->Find(document_id);
+}
+
+const ForwardIndex::DocumentWords* ForwardIndex::Page::Find(int document_id) const {
+    const auto it = LowerBoundId(documents, document_id);
+    return it != documents.end() && it->first == document_id ? &it->second : nullptr;
+}
+
+void ForwardIndex::Page::Squeeze() {
+    std::vector<ForwardEntry> squeezed;
+    squeezed.reserve(entries.size() - hole_size);
+    for (auto& [document_id, words] : documents) {
+        const auto first = entries.begin() + static_cast<std::ptrdiff_t>(words.offset);
+        words.offset = squeezed.size();
+        squeezed.insert(squeezed.end(), first, first + words.count);
+    }
+    entries = std::move(squeezed);
+    hole_size = 0;
+}
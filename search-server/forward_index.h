@@ -0,0 +1,86 @@
+#pragma once
+#include "memory_stats.h"
+#include "shared_pages.h"
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Word of a document as the forward index keeps it, the term frequency is occurrences / document length
+struct ForwardEntry {
+    int word_id;
+    int occurrences;
+};
+
+// Words of every document as runs of entries sorted by word id. Documents of 2^PAGE_BITS consecutive ids share
+// a page with one array of runs, copies of the index share the pages they did not change.
+// Removed documents leave holes, the array of a page is squeezed once holes take half of it.
+class ForwardIndex {
+public:
+    static constexpr int PAGE_BITS = 8;
+
+    // Entries must be sorted by word id
+    void Add(int document_id, int document_length, const std::vector<ForwardEntry>& entries);
+
+    void Remove(int document_id);
+
+    bool Contains(int document_id) const;
+
+    // Words of the document sorted by id, an empty range for documents missing from the index
+    std::pair<const ForwardEntry*, const ForwardEntry*> GetWords(int document_id) const;
+
+    // Number of words of the document, stop words excluded
+    int GetDocumentLength(int document_id) const;
+
+    // Moves the words to new_word_ids[word_id], new ids must keep the order of the words of a document
+    void RenumberWords(const std::vector<int>& new_word_ids);
+
+    size_t GetMemoryBytes() const;
+
+private:
+    struct DocumentWords {
+        size_t offset;
+        int count;
+        int length;
+    };
+
+    struct Page {
+        std::vector<ForwardEntry> entries;
+        // Sorted by document id
+        std::vector<std::pair<int, DocumentWords>> documents;
+        size_t hole_size = 0;
+
+        const DocumentWords* Find(int document_id) const;
+
+        // Drops the holes and trims the array to its size
+        void Squeeze();
+    };
+
+    SharedPages<Page> pages_;
+
+    const DocumentWords* Find(int document_id) const;
+};
+
+// Calls action(i) for every word_ids[i] found among the entries [first, last), both sorted by word id.
+// Every id gallops forward from the previous one, so k ids cost O(k log(n / k)) on n entries.
+template <typename Entry, typename Action>
+void IntersectWordIds(const Entry* first, const Entry* last, const std::vector<int>& word_ids, Action action) {
+    for (size_t i = 0; i < word_ids.size() && first != last; ++i) {
+        const int word_id = word_ids[i];
+        // Steps double until an entry reaches the id, then the last step is bisected
+        const Entry* bound = first;
+        size_t step = 1;
+        while (bound != last && bound->word_id < word_id) {
+            first = bound + 1;
+            bound = static_cast<size_t>(last - bound) > step ? bound + step : last;
+            step *= 2;
+        }
+        first = std::lower_bound(first, bound, word_id, [](const Entry& entry, int id) {
+            return entry.word_id < id;
+        });
+        if (first != last && first->word_id == word_id) {
+            action(i);
+            ++first;
+        }
+    }
+}
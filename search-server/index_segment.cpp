@@ -0,0 +1,254 @@
+#include "index_segment.h"
+#include <execution>
+#include <numeric>
+
+IndexSegment::IndexSegment(WordPostings postings, std::vector<int> document_ids,
+                           DocumentLengths lengths, std::shared_ptr<const IndexSnapshot> snapshot)
+        : postings_(std::move(postings))
+        , document_ids_(std::move(document_ids))
+        , lengths_(std::move(lengths))
+        , snapshot_(std::move(snapshot)) {
+    for (const auto& [word_id, list] : postings_) {
+        posting_count_ += list.size();
+    }
+}
+
+const PostingList* IndexSegment::GetPostings(int word_id) const {
+    const size_t position = FindPosition(word_id);
+    if (position == postings_.size() || postings_[position].second.empty()) {
+        return nullptr;
+    }
+    return &postings_[position].second;
+}
+
+size_t IndexSegment::GetDocumentCount() const {
+    return document_ids_.size();
+}
+
+size_t IndexSegment::GetPostingCount() const {
+    return posting_count_;
+}
+
+bool IndexSegment::HasDocument(int document_id) const {
+    return std::binary_search(document_ids_.begin(), document_ids_.end(), document_id);
+}
+
+const DocumentLengths& IndexSegment::GetDocumentLengths() const {
+    return lengths_;
+}
+
+void IndexSegment::AddDocument(int document_id, int document_length) {
+    // Ids mostly grow, then the insertion is at the end
+    document_ids_.insert(std::lower_bound(document_ids_.begin(), document_ids_.end(), document_id), document_id);
+    lengths_.Set(document_id, document_length);
+}
+
+void IndexSegment::InsertPosting(int word_id, const PostingEntry& entry) {
+    GetOrAddPostings(word_id).Insert(entry, lengths_);
+    ++posting_count_;
+}
+
+void IndexSegment::AddPostings(const std::vector<std::pair<int, std::vector<PostingEntry>>>& word_entries) {
+    // Lists are created up front, the parallel merges below only look them up
+    for (const auto& [word_id, entries] : word_entries) {
+        GetOrAddPostings(word_id);
+        posting_count_ += entries.size();
+    }
+    std::vector<PostingList*> lists;
+    lists.reserve(word_entries.size());
+    for (const auto& [word_id, entries] : word_entries) {
+        lists.push_back(&postings_[FindPosition(word_id)].second);
+    }
+    std::vector<size_t> indexes(word_entries.size());
+    std::iota(indexes.begin(), indexes.end(), 0);
+    std::for_each(std::execution::par,
+                  indexes.begin(),
+                  indexes.end(),
+                  [&](size_t i) {
+                      lists[i]->Merge(word_entries[i].second, lengths_);
+                  });
+}
+
+IndexSegment IndexSegment::Merge(const std::vector<const IndexSegment*>& segments,
+                                 const std::vector<const RemovedDocuments*>& removed) {
+    std::vector<int> word_ids;
+    std::vector<int> document_ids;
+    DocumentLengths lengths;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        for (const auto& [word_id, list] : segments[i]->postings_) {
+            word_ids.push_back(word_id);
+        }
+        for (const int document_id : segments[i]->document_ids_) {
+            if (removed[i] == nullptr || removed[i]->count(document_id) == 0) {
+                document_ids.push_back(document_id);
+                lengths.Set(document_id, segments[i]->lengths_.Get(document_id));
+            }
+        }
+    }
+    std::sort(word_ids.begin(), word_ids.end());
+    word_ids.erase(std::unique(word_ids.begin(), word_ids.end()), word_ids.end());
+    std::sort(document_ids.begin(), document_ids.end());
+
+    std::vector<PostingList> lists(word_ids.size());
+    std::vector<size_t> indexes(word_ids.size());
+    std::iota(indexes.begin(), indexes.end(), 0);
+    std::for_each(std::execution::par,
+                  indexes.begin(),
+                  indexes.end(),
+                  [&](size_t i) {
+                      lists[i] = CollectPostings(word_ids[i], segments, removed);
+                  });
+
+    WordPostings postings;
+    postings.reserve(word_ids.size());
+    for (size_t i = 0; i < word_ids.size(); ++i) {
+        if (!lists[i].empty()) {
+            postings.emplace_back(word_ids[i], std::move(lists[i]));
+        }
+    }
+    IndexSegment merged(std::move(postings), std::move(document_ids), std::move(lengths));
+    merged.Seal();
+    return merged;
+}
+
+PostingList IndexSegment::CollectPostings(int word_id, const std::vector<const IndexSegment*>& segments,
+                                          const std::vector<const RemovedDocuments*>& removed) {
+    std::vector<PostingEntry> entries;
+    PostingEntry buffer[PostingList::BLOCK_SIZE];
+    size_t sorted_count = 0;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        const PostingList* list = segments[i]->GetPostings(word_id);
+        if (list == nullptr) {
+            continue;
+        }
+        for (size_t block = 0; block < list->GetBlockCount(); ++block) {
+            const size_t count = list->DecodeEntries(block, segments[i]->lengths_, buffer);
+            for (size_t j = 0; j < count; ++j) {
+                if (removed[i] == nullptr || removed[i]->count(buffer[j].document_id) == 0) {
+                    entries.push_back(buffer[j]);
+                }
+            }
+        }
+        // Every segment adds a sorted run of ids
+        std::inplace_merge(entries.begin(), entries.begin() + sorted_count, entries.end(),
+                           [](const PostingEntry& lhs, const PostingEntry& rhs) {
+                               return lhs.document_id < rhs.document_id;
+                           });
+        sorted_count = entries.size();
+    }
+    // Entries carry their lengths, the list is built without looking any up
+    PostingList postings;
+    postings.Merge(entries, DocumentLengths());
+    return postings;
+}
+
+IndexSegment IndexSegment::Compact(const IndexSegment& segment, const RemovedDocuments* removed,
+                                   const std::vector<int>& new_word_ids) {
+    const bool has_removed = removed != nullptr && !removed->empty();
+    WordPostings postings;
+    for (const auto& [word_id, list] : segment.postings_) {
+        if (list.empty() || new_word_ids[word_id] < 0) {
+            continue;
+        }
+        // Lists are copied to fit, or all encoded again and sealed below if documents were removed. Copies may
+        // still borrow from the snapshot or from the storages of the segment, so the compacted segment keeps them too.
+        PostingList compacted = has_removed ? CollectPostings(word_id, {&segment}, {removed}) : list;
+        if (!compacted.empty()) {
+            postings.emplace_back(new_word_ids[word_id], std::move(compacted));
+        }
+    }
+    // Lists of a segment still taking postings come in no order
+    std::sort(postings.begin(), postings.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.first < rhs.first;
+    });
+    std::vector<int> document_ids;
+    for (const int document_id : segment.document_ids_) {
+        if (!has_removed || removed->count(document_id) == 0) {
+            document_ids.push_back(document_id);
+        }
+    }
+    IndexSegment compacted(std::move(postings), std::move(document_ids), segment.lengths_, segment.snapshot_);
+    // Lists rebuilt without removed documents borrow nothing from the source
+    if (has_removed) {
+        compacted.Seal();
+    } else {
+        compacted.encoded_ = segment.encoded_;
+    }
+    return compacted;
+}
+
+void IndexSegment::Seal() {
+    postings_.erase(std::remove_if(postings_.begin(), postings_.end(),
+                                   [](const std::pair<int, PostingList>& word_postings) {
+                                       return word_postings.second.empty();
+                                   }),
+                    postings_.end());
+    std::sort(postings_.begin(), postings_.end(), [](const auto& lhs, const auto& rhs) {
+        return lhs.first < rhs.first;
+    });
+    postings_.shrink_to_fit();
+    positions_ = {};
+
+    // Lists are encoded first and borrow after, once the storage no longer grows
+    auto encoded = std::make_shared<EncodedPostings>();
+    std::vector<std::pair<size_t, size_t>> starts;
+    for (const auto& [word_id, list] : postings_) {
+        if (!list.IsBorrowed()) {
+            starts.emplace_back(encoded->blocks.size(), encoded->data.size());
+            list.Encode(encoded->blocks, encoded->data);
+        }
+    }
+    if (starts.empty()) {
+        return;
+    }
+    encoded->blocks.shrink_to_fit();
+    encoded->data.shrink_to_fit();
+    size_t i = 0;
+    for (auto& [word_id, list] : postings_) {
+        if (list.IsBorrowed()) {
+            continue;
+        }
+        const auto [first_block, data_start] = starts[i];
+        const size_t last_block = i + 1 < starts.size() ? starts[i + 1].first : encoded->blocks.size();
+        list = PostingList::Borrow(encoded->blocks.data() + first_block, last_block - first_block,
+                                   encoded->data.data() + data_start, list.size(), list.GetMaxTermFreq());
+        ++i;
+    }
+    encoded_.push_back(std::move(encoded));
+}
+
+size_t IndexSegment::GetMemoryBytes() const {
+    size_t bytes = EstimateVectorBytes(postings_) + EstimateHashBytes(positions_) + EstimateVectorBytes(document_ids_)
+                   + lengths_.GetMemoryBytes();
+    for (const auto& [word_id, list] : postings_) {
+        bytes += list.GetMemoryBytes();
+    }
+    for (const std::shared_ptr<const EncodedPostings>& encoded : encoded_) {
+        bytes += sizeof(EncodedPostings) + EstimateVectorBytes(encoded->blocks) + EstimateVectorBytes(encoded->data);
+    }
+    return bytes;
+}
+
+size_t IndexSegment::FindPosition(int word_id) const {
+    if (!positions_.empty()) {
+        const auto it = positions_.find(word_id);
+        return it == positions_.end() ? postings_.size() : it->second;
+    }
+    const auto it = LowerBoundId(postings_, word_id);
+    return it != postings_.end() && it->first == word_id ? static_cast<size_t>(it - postings_.begin())
+                                                         : postings_.size();
+}
+
+PostingList& IndexSegment::GetOrAddPostings(int word_id) {
+    // Lists of a compacted segment come sorted, their positions are taken before it appends
+    if (positions_.empty()) {
+        for (size_t i = 0; i < postings_.size(); ++i) {
+            positions_.emplace(postings_[i].first, i);
+        }
+    }
+    const auto [it, inserted] = positions_.emplace(word_id, postings_.size());
+    if (inserted) {
+        postings_.emplace_back(word_id, PostingList());
+    }
+    return postings_[it->second].second;
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include "posting_list.h"
+#include "memory_stats.h"
+#include "shared_pages.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+// Documents removed from a sealed segment. Their postings stay in the segment until it is merged, readers skip them.
+using RemovedDocuments = std::unordered_set<int>;
+
+class IndexSnapshot;
+
+// Postings of the lists of a sealed segment encoded back to back, the lists borrow their blocks from here
+struct EncodedPostings {
+    std::vector<PostingBlock> blocks;
+    std::vector<uint8_t> data;
+};
+
+// Part of the inverted index: posting lists of a set of documents, by word id.
+// The server changes only its newest segment, sealed segments are immutable and shared between
+// versions of the server until a merge replaces them.
+class IndexSegment {
+public:
+    // Lists with their word ids. An array costs a segment less than a hash map of many short lists:
+    // lists of a sealed segment are sorted by word id and found by binary search, a segment taking
+    // postings appends the lists of new words and finds them through a map of positions until it is sealed.
+    using WordPostings = std::vector<std::pair<int, PostingList>>;
+
+    IndexSegment() = default;
+
+    // Postings and document ids must be sorted, lengths must hold the length of every document. Lists borrowing
+    // their blocks from a snapshot keep it mapped through the segment, merges in progress may outlive the server
+    // that loaded it.
+    IndexSegment(WordPostings postings, std::vector<int> document_ids,
+                 DocumentLengths lengths, std::shared_ptr<const IndexSnapshot> snapshot = nullptr);
+
+    // Postings of the word, nullptr if no document of the segment has it
+    const PostingList* GetPostings(int word_id) const;
+
+    size_t GetDocumentCount() const;
+
+    size_t GetPostingCount() const;
+
+    // Also true for documents that are removed but still have postings here
+    bool HasDocument(int document_id) const;
+
+    // Lengths of the documents of the segment, posting lists of the segment are decoded with them
+    const DocumentLengths& GetDocumentLengths() const;
+
+    void AddDocument(int document_id, int document_length);
+
+    void InsertPosting(int word_id, const PostingEntry& entry);
+
+    // Adds postings of many words at once, lists of different words are merged in parallel.
+    // Entries of a word must be sorted by id and new to the segment.
+    void AddPostings(const std::vector<std::pair<int, std::vector<PostingEntry>>>& word_entries);
+
+    // Erases the postings of the document for the given words, they must be all of its words in the segment
+    template <class Execution>
+    void RemoveDocument(Execution&& policy, int document_id, const std::vector<int>& word_ids);
+
+    // One segment with the postings of all given segments except removed documents.
+    // removed[i] lists documents removed from segments[i] and may be nullptr.
+    static IndexSegment Merge(const std::vector<const IndexSegment*>& segments,
+                              const std::vector<const RemovedDocuments*>& removed);
+
+    // Postings of one word over the given segments except removed documents
+    static PostingList CollectPostings(int word_id, const std::vector<const IndexSegment*>& segments,
+                                       const std::vector<const RemovedDocuments*>& removed);
+
+    // Copy of the segment without removed documents and empty lists, the postings of a word move to
+    // new_word_ids[word_id]. Words with a negative new id must have no postings left.
+    static IndexSegment Compact(const IndexSegment& segment, const RemovedDocuments* removed,
+                                const std::vector<int>& new_word_ids);
+
+    // Encodes the lists changed since they were borrowed into one storage shared by copies of the segment,
+    // so that they lose their tails and per-list allocations, drops empty lists and sorts the others by word id.
+    // Called once no more postings are added to the segment.
+    void Seal();
+
+    // Heap bytes of the segment, postings borrowed from a snapshot are not counted
+    size_t GetMemoryBytes() const;
+
+private:
+    WordPostings postings_;
+    // Positions of the lists by word id while postings_ is unsorted, empty when it is sorted
+    std::unordered_map<int, size_t> positions_;
+    std::vector<int> document_ids_;
+    size_t posting_count_ = 0;
+    DocumentLengths lengths_;
+    std::shared_ptr<const IndexSnapshot> snapshot_;
+    // Storages of the lists encoded by Seal, a compacted segment may borrow from those of its source
+    std::vector<std::shared_ptr<const EncodedPostings>> encoded_;
+
+    // Position of the list of the word in postings_, postings_.size() if there is none
+    size_t FindPosition(int word_id) const;
+
+    // Adds an empty list if the word has none
+    PostingList& GetOrAddPostings(int word_id);
+};
+
+template <class Execution>
+void IndexSegment::RemoveDocument(Execution&& policy, int document_id, const std::vector<int>& word_ids) {
+    // Lists are only looked up here, so different words can be changed concurrently
+    std::for_each(policy,
+                  word_ids.begin(),
+                  word_ids.end(),
+                  [&](int word_id) {
+                      postings_[FindPosition(word_id)].second.Erase(document_id, lengths_);
+                  });
+    posting_count_ -= word_ids.size();
+    document_ids_.erase(std::lower_bound(document_ids_.begin(), document_ids_.end(), document_id));
+}
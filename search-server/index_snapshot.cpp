@@ -0,0 +1,319 @@
+#include "index_snapshot.h"
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(SnapshotHeader) == 128, "Unexpected snapshot header layout");
+static_assert(sizeof(SnapshotWord) == 56, "Unexpected snapshot word layout");
+static_assert(sizeof(SnapshotDocument) == 48, "Unexpected snapshot document layout");
+static_assert(sizeof(SnapshotForward) == 16, "Unexpected snapshot forward entry layout");
+static_assert(sizeof(PostingBlock) == 32, "Unexpected posting block layout");
+
+IndexSnapshot::IndexSnapshot(const std::string& path) {
+#ifndef _WIN32
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open index snapshot " + path);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+        close(fd);
+        throw std::runtime_error("Cannot read index snapshot " + path);
+    }
+    size_ = static_cast<size_t>(file_stat.st_size);
+    if (size_ > 0) {
+        void* mapping = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Cannot map index snapshot " + path);
+        }
+        data_ = static_cast<const char*>(mapping);
+    }
+    close(fd);
+#else
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open index snapshot " + path);
+    }
+    buffer_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    data_ = buffer_.data();
+    size_ = buffer_.size();
+#endif
+    try {
+        ReadHeader();
+    } catch (...) {
+        Unmap();
+        throw;
+    }
+}
+
+IndexSnapshot::~IndexSnapshot() {
+    Unmap();
+}
+
+std::vector<std::string> IndexSnapshot::GetStopWords() const {
+    std::vector<std::string> stop_words;
+    stop_words.reserve(header_.stop_words.count);
+    for (size_t i = 0; i < header_.stop_words.count; ++i) {
+        stop_words.emplace_back(GetText(stop_words_[i]));
+    }
+    return stop_words;
+}
+
+size_t IndexSnapshot::GetWordCount() const {
+    return header_.words.count;
+}
+
+std::string_view IndexSnapshot::GetWord(int word_id) const {
+    return GetText(words_[word_id].text);
+}
+
+int IndexSnapshot::FindWord(std::string_view word) const {
+    const SnapshotWord* last = words_ + header_.words.count;
+    const SnapshotWord* it = std::lower_bound(words_, last, word,
+                                              [this](const SnapshotWord& record, std::string_view text) {
+                                                  return GetText(record.text) < text;
+                                              });
+    if (it == last || GetText(it->text) != word) {
+        return -1;
+    }
+    return static_cast<int>(it - words_);
+}
+
+std::pair<int, int> IndexSnapshot::FindWordPrefix(std::string_view prefix) const {
+    const SnapshotWord* last = words_ + header_.words.count;
+    const SnapshotWord* first = std::lower_bound(words_, last, prefix,
+                                                 [this](const SnapshotWord& record, std::string_view text) {
+                                                     return GetText(record.text) < text;
+                                                 });
+    last = std::upper_bound(first, last, prefix,
+                            [this](std::string_view text, const SnapshotWord& record) {
+                                return text < GetText(record.text).substr(0, text.size());
+                            });
+    return {static_cast<int>(first - words_), static_cast<int>(last - words_)};
+}
+
+PostingList IndexSnapshot::GetPostings(int word_id) const {
+    const SnapshotWord& record = words_[word_id];
+    return PostingList::Borrow(posting_blocks_ + record.blocks_offset, record.block_count,
+                               posting_data_ + record.data_offset, record.posting_count, record.max_term_freq);
+}
+
+size_t IndexSnapshot::GetDocumentCount() const {
+    return header_.documents.count;
+}
+
+const SnapshotDocument& IndexSnapshot::GetDocument(size_t index) const {
+    return documents_[index];
+}
+
+std::string_view IndexSnapshot::GetDocumentText(size_t index) const {
+    return GetText(documents_[index].text);
+}
+
+std::pair<const SnapshotForward*, const SnapshotForward*> IndexSnapshot::GetDocumentWords(int document_id) const {
+    const SnapshotDocument* last = documents_ + header_.documents.count;
+    const SnapshotDocument* it = std::lower_bound(documents_, last, document_id,
+                                                  [](const SnapshotDocument& record, int id) {
+                                                      return record.id < id;
+                                                  });
+    if (it == last || it->id != document_id) {
+        return {nullptr, nullptr};
+    }
+    const SnapshotForward* first = forward_ + it->forward_offset;
+    const SnapshotForward* end = first + it->forward_count;
+    if (std::any_of(first, end, [this](const SnapshotForward& entry) {
+            return entry.word_id < 0 || static_cast<uint64_t>(entry.word_id) >= header_.words.count;
+        })) {
+        throw std::runtime_error("Corrupted index snapshot: unknown word id");
+    }
+    return {first, end};
+}
+
+std::map<std::string_view, double> IndexSnapshot::GetWordFrequencies(int document_id) const {
+    std::map<std::string_view, double> word_freqs;
+    const auto [first, last] = GetDocumentWords(document_id);
+    for (const SnapshotForward* entry = first; entry != last; ++entry) {
+        word_freqs.emplace(GetWord(entry->word_id), entry->term_freq);
+    }
+    return word_freqs;
+}
+
+size_t IndexSnapshot::GetFileSize() const {
+    return size_;
+}
+
+void IndexSnapshot::ReadHeader() {
+    if (size_ < sizeof(SnapshotHeader)) {
+        throw std::runtime_error("Not an index snapshot: file is too short");
+    }
+    std::memcpy(&header_, data_, sizeof(SnapshotHeader));
+    if (std::memcmp(header_.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0) {
+        throw std::runtime_error("Not an index snapshot: wrong magic");
+    }
+    if (header_.byte_order_mark != SNAPSHOT_BYTE_ORDER_MARK) {
+        throw std::runtime_error("Index snapshot was written with another byte order");
+    }
+    if (header_.version != SNAPSHOT_VERSION) {
+        throw std::runtime_error("Unsupported index snapshot version " + std::to_string(header_.version));
+    }
+
+    auto locate = [this](const SnapshotSection& section, size_t record_size) {
+        if (section.offset % 8 != 0 || section.offset > size_
+            || section.count > (size_ - section.offset) / record_size) {
+            throw std::runtime_error("Corrupted index snapshot: section out of file");
+        }
+        return data_ + section.offset;
+    };
+    stop_words_ = reinterpret_cast<const SnapshotText*>(locate(header_.stop_words, sizeof(SnapshotText)));
+    words_ = reinterpret_cast<const SnapshotWord*>(locate(header_.words, sizeof(SnapshotWord)));
+    posting_blocks_ = reinterpret_cast<const PostingBlock*>(locate(header_.posting_blocks, sizeof(PostingBlock)));
+    posting_data_ = reinterpret_cast<const uint8_t*>(locate(header_.posting_data, 1));
+    documents_ = reinterpret_cast<const SnapshotDocument*>(locate(header_.documents, sizeof(SnapshotDocument)));
+    forward_ = reinterpret_cast<const SnapshotForward*>(locate(header_.forward, sizeof(SnapshotForward)));
+    strings_ = locate(header_.strings, 1);
+
+    // Records and block metadata are checked here, encoded postings and forward contents are trusted
+    auto is_text_valid = [this](const SnapshotText& text) {
+        return text.offset <= header_.strings.count && text.length <= header_.strings.count - text.offset;
+    };
+    auto is_range_valid = [](uint64_t offset, uint64_t count, const SnapshotSection& section) {
+        return offset <= section.count && count <= section.count - offset;
+    };
+    for (size_t i = 0; i < header_.stop_words.count; ++i) {
+        if (!is_text_valid(stop_words_[i])) {
+            throw std::runtime_error("Corrupted index snapshot: bad stop word");
+        }
+    }
+    for (size_t i = 0; i < header_.words.count; ++i) {
+        const SnapshotWord& word = words_[i];
+        if (!is_text_valid(word.text) || !is_range_valid(word.blocks_offset, word.block_count, header_.posting_blocks)
+            || word.data_offset > header_.posting_data.count) {
+            throw std::runtime_error("Corrupted index snapshot: bad word record");
+        }
+        const uint64_t data_size = header_.posting_data.count - word.data_offset;
+        uint64_t posting_count = 0;
+        for (size_t block = 0; block < word.block_count; ++block) {
+            const PostingBlock& meta = posting_blocks_[word.blocks_offset + block];
+            posting_count += meta.count;
+            if (meta.count == 0 || meta.count > PostingList::BLOCK_SIZE || meta.offset > data_size
+                || meta.size > data_size - meta.offset || meta.first_document_id > meta.last_document_id) {
+                throw std::runtime_error("Corrupted index snapshot: bad posting block");
+            }
+        }
+        if (posting_count != word.posting_count) {
+            throw std::runtime_error("Corrupted index snapshot: bad word record");
+        }
+    }
+    for (size_t i = 0; i < header_.documents.count; ++i) {
+        const SnapshotDocument& document = documents_[i];
+        if (document.id < 0 || (i > 0 && documents_[i - 1].id >= document.id)
+            || document.status < static_cast<int32_t>(DocumentStatus::ACTUAL)
+            || document.status > static_cast<int32_t>(DocumentStatus::REMOVED)
+            || !is_text_valid(document.text)
+            || !is_range_valid(document.forward_offset, document.forward_count, header_.forward)) {
+            throw std::runtime_error("Corrupted index snapshot: bad document record");
+        }
+    }
+}
+
+void IndexSnapshot::Unmap() {
+#ifndef _WIN32
+    if (data_ != nullptr) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+#endif
+    data_ = nullptr;
+    size_ = 0;
+}
+
+std::string_view IndexSnapshot::GetText(const SnapshotText& text) const {
+    return {strings_ + text.offset, static_cast<size_t>(text.length)};
+}
+
+void IndexSnapshotWriter::AddStopWord(std::string_view word) {
+    stop_words_.push_back(AddText(word));
+}
+
+void IndexSnapshotWriter::AddWord(std::string_view word, const PostingList& postings) {
+    const size_t blocks_offset = posting_blocks_.size();
+    const size_t data_offset = posting_data_.size();
+    postings.Encode(posting_blocks_, posting_data_);
+    words_.push_back({AddText(word), blocks_offset, posting_blocks_.size() - blocks_offset, data_offset,
+                      postings.size(), postings.GetMaxTermFreq()});
+}
+
+void IndexSnapshotWriter::AddDocument(int document_id, int rating, DocumentStatus status, int length,
+                                      std::string_view text, const std::vector<std::pair<int, double>>& words) {
+    documents_.push_back({document_id, rating, static_cast<int32_t>(status), static_cast<uint32_t>(length),
+                          AddText(text), forward_.size(), words.size()});
+    for (const auto& [word_id, term_freq] : words) {
+        forward_.push_back({word_id, 0, term_freq});
+    }
+}
+
+void IndexSnapshotWriter::Write(const std::string& path) const {
+    SnapshotHeader header{};
+    std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+    header.version = SNAPSHOT_VERSION;
+    header.byte_order_mark = SNAPSHOT_BYTE_ORDER_MARK;
+    uint64_t offset = sizeof(SnapshotHeader);
+    auto place = [&offset](SnapshotSection& section, size_t count, size_t record_size) {
+        offset = (offset + 7) / 8 * 8;
+        section = {offset, count};
+        offset += count * record_size;
+    };
+    place(header.stop_words, stop_words_.size(), sizeof(SnapshotText));
+    place(header.words, words_.size(), sizeof(SnapshotWord));
+    place(header.posting_blocks, posting_blocks_.size(), sizeof(PostingBlock));
+    place(header.posting_data, posting_data_.size(), 1);
+    place(header.documents, documents_.size(), sizeof(SnapshotDocument));
+    place(header.forward, forward_.size(), sizeof(SnapshotForward));
+    place(header.strings, strings_.size(), 1);
+
+    // The file is replaced only when completely written, a server mapping the old file keeps working
+    const std::string temp_path = path + ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out) {
+            throw std::runtime_error("Cannot create index snapshot " + path);
+        }
+        auto write_section = [&out](const SnapshotSection& section, const void* data, size_t record_size) {
+            static const char zeros[8] = {};
+            out.write(zeros, static_cast<std::streamsize>(section.offset - static_cast<uint64_t>(out.tellp())));
+            out.write(static_cast<const char*>(data), static_cast<std::streamsize>(section.count * record_size));
+        };
+        out.write(reinterpret_cast<const char*>(&header), sizeof(SnapshotHeader));
+        write_section(header.stop_words, stop_words_.data(), sizeof(SnapshotText));
+        write_section(header.words, words_.data(), sizeof(SnapshotWord));
+        write_section(header.posting_blocks, posting_blocks_.data(), sizeof(PostingBlock));
+        write_section(header.posting_data, posting_data_.data(), 1);
+        write_section(header.documents, documents_.data(), sizeof(SnapshotDocument));
+        write_section(header.forward, forward_.data(), sizeof(SnapshotForward));
+        write_section(header.strings, strings_.data(), 1);
+        if (!out.flush()) {
+            throw std::runtime_error("Cannot write index snapshot " + path);
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temp_path, path, error);
+    if (error) {
+        std::filesystem::remove(temp_path, error);
+        throw std::runtime_error("Cannot replace index snapshot " + path);
+    }
+}
+
+SnapshotText IndexSnapshotWriter::AddText(std::string_view text) {
+    const SnapshotText record = {strings_.size(), text.size()};
+    strings_.append(text);
+    return record;
+}
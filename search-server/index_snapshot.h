@@ -0,0 +1,159 @@
+#pragma once
+#include "document.h"
+#include "posting_list.h"
+#include <cstdint>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Binary layout of an index snapshot file. The header is followed by sections, each an array of
+// the records below starting at an 8-byte aligned offset. All texts live in the strings section.
+constexpr char SNAPSHOT_MAGIC[8] = {'S', 'R', 'C', 'H', 'I', 'D', 'X', '\0'};
+constexpr uint32_t SNAPSHOT_VERSION = 2;
+// Written as is, a snapshot from a machine with another byte order reads back as a different value
+constexpr uint32_t SNAPSHOT_BYTE_ORDER_MARK = 0x01020304;
+
+struct SnapshotSection {
+    uint64_t offset;
+    uint64_t count;
+};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order_mark;
+    SnapshotSection stop_words;
+    SnapshotSection words;
+    SnapshotSection posting_blocks;
+    SnapshotSection posting_data;
+    SnapshotSection documents;
+    SnapshotSection forward;
+    SnapshotSection strings;
+};
+
+struct SnapshotText {
+    uint64_t offset;
+    uint64_t length;
+};
+
+// Words are sorted by text, the position of a word is its id. Postings are stored compressed,
+// as PostingList keeps them: blocks_offset indexes posting_blocks, data_offset indexes posting_data.
+struct SnapshotWord {
+    SnapshotText text;
+    uint64_t blocks_offset;
+    uint64_t block_count;
+    uint64_t data_offset;
+    uint64_t posting_count;
+    double max_term_freq;
+};
+
+// Documents are sorted by id, forward entries list the words of the document. Postings keep occurrences,
+// length is the number of words of the document they are divided by.
+struct SnapshotDocument {
+    int32_t id;
+    int32_t rating;
+    int32_t status;
+    uint32_t length;
+    SnapshotText text;
+    uint64_t forward_offset;
+    uint64_t forward_count;
+};
+
+struct SnapshotForward {
+    int32_t word_id;
+    uint32_t reserved;
+    double term_freq;
+};
+
+// Read-only view of a snapshot file mapped into memory
+class IndexSnapshot {
+public:
+    // Throws std::runtime_error if the file cannot be mapped or is not a snapshot of this version
+    explicit IndexSnapshot(const std::string& path);
+
+    IndexSnapshot(const IndexSnapshot&) = delete;
+
+    IndexSnapshot& operator=(const IndexSnapshot&) = delete;
+
+    ~IndexSnapshot();
+
+    std::vector<std::string> GetStopWords() const;
+
+    size_t GetWordCount() const;
+
+    std::string_view GetWord(int word_id) const;
+
+    // Binary search over the sorted word table, -1 if the word is absent
+    int FindWord(std::string_view word) const;
+
+    // Ids [first, last) of the words starting with the prefix, sorted words make them one run
+    std::pair<int, int> FindWordPrefix(std::string_view prefix) const;
+
+    // Postings borrowed from the mapped file
+    PostingList GetPostings(int word_id) const;
+
+    size_t GetDocumentCount() const;
+
+    const SnapshotDocument& GetDocument(size_t index) const;
+
+    std::string_view GetDocumentText(size_t index) const;
+
+    // Forward entries of a document, an empty range for documents missing from the snapshot
+    std::pair<const SnapshotForward*, const SnapshotForward*> GetDocumentWords(int document_id) const;
+
+    // Built from the forward entries on every call, words point into the mapped file
+    std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
+
+    // Size of the snapshot file
+    size_t GetFileSize() const;
+
+private:
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    // Only used where mmap is unavailable, then the file is read into memory
+    std::vector<char> buffer_;
+
+    SnapshotHeader header_;
+    const SnapshotText* stop_words_ = nullptr;
+    const SnapshotWord* words_ = nullptr;
+    const PostingBlock* posting_blocks_ = nullptr;
+    const uint8_t* posting_data_ = nullptr;
+    const SnapshotDocument* documents_ = nullptr;
+    const SnapshotForward* forward_ = nullptr;
+    const char* strings_ = nullptr;
+
+    void ReadHeader();
+
+    void Unmap();
+
+    std::string_view GetText(const SnapshotText& text) const;
+};
+
+// Collects the contents of a snapshot and writes them in the layout above
+class IndexSnapshotWriter {
+public:
+    void AddStopWord(std::string_view word);
+
+    // Words must be added in ascending order of text, the n-th added word gets id n
+    void AddWord(std::string_view word, const PostingList& postings);
+
+    // Documents must be added in ascending order of id, words are pairs of word id and term frequency
+    void AddDocument(int document_id, int rating, DocumentStatus status, int length, std::string_view text,
+                     const std::vector<std::pair<int, double>>& words);
+
+    // Throws std::runtime_error if the file cannot be written
+    void Write(const std::string& path) const;
+
+private:
+    std::vector<SnapshotText> stop_words_;
+    std::vector<SnapshotWord> words_;
+    std::vector<PostingBlock> posting_blocks_;
+    std::vector<uint8_t> posting_data_;
+    std::vector<SnapshotDocument> documents_;
+    std::vector<SnapshotForward> forward_;
+    std::string strings_;
+
+    SnapshotText AddText(std::string_view text);
+};
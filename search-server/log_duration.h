@@ -1,6 +1,8 @@
 #pragma once
+#include "metrics.h"
 #include <chrono>
 #include <iostream>
+#include <string>
 
 #define PROFILE_CONCAT_INTERNAL(X, Y) X##Y
 #define PROFILE_CONCAT(X, Y) PROFILE_CONCAT_INTERNAL(X, Y)
@@ -20,17 +22,21 @@ public:
               {
     }
 
+    // Время записывается в гистограмму реестра метрик под именем id и выводится в микросекундах
     ~LogDuration() {
         using namespace std::chrono;
         using namespace std::literals;
 
         const auto end_time = Clock::now();
         const auto dur = end_time - start_time_;
-        os_  << "Operation time: "s << duration_cast<milliseconds>(dur).count() << " ms"s << std::endl;
+        // Когда все имена гистограмм заняты, длительность только выводится
+        MetricsRegistry& metrics = GetMetrics();
+        metrics.Record(metrics.GetHistogramId(id_), static_cast<uint64_t>(duration_cast<nanoseconds>(dur).count()));
+        os_ << id_ << ": "s << duration_cast<microseconds>(dur).count() << " us"s << std::endl;
     }
 
 private:
     const std::string id_;
     const Clock::time_point start_time_ = Clock::now();
-     std::ostream& os_;
-};
\ No newline at end of file
+    std::ostream& os_;
+};
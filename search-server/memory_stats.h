@@ -0,0 +1,42 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+// Heap memory taken by the parts of a search server, in bytes
+struct MemoryStats {
+    // Words of the dictionary and their document frequencies
+    size_t dictionary_bytes = 0;
+    // Inverted index of all segments, sealed segments shared with forks are counted by every fork
+    size_t posting_bytes = 0;
+    // Words and term frequencies of every document
+    size_t forward_index_bytes = 0;
+    size_t document_text_bytes = 0;
+    // Ratings, statuses and ids of documents
+    size_t document_metadata_bytes = 0;
+    // File of the loaded snapshot, mapped rather than allocated and not part of the total
+    size_t mapped_bytes = 0;
+    size_t term_count = 0;
+    // Terms no document has any more, Compact drops those that are not in the loaded snapshot
+    size_t dead_term_count = 0;
+
+    size_t GetTotalBytes() const {
+        return dictionary_bytes + posting_bytes + forward_index_bytes + document_text_bytes + document_metadata_bytes;
+    }
+};
+
+// Estimates of the memory of standard containers. A tree node is taken to hold three pointers and a color,
+// a hash node a pointer and a cached hash, besides the value.
+template <typename Tree>
+size_t EstimateTreeBytes(const Tree& tree) {
+    return tree.size() * (sizeof(typename Tree::value_type) + 4 * sizeof(void*));
+}
+
+template <typename HashMap>
+size_t EstimateHashBytes(const HashMap& map) {
+    return map.size() * (sizeof(typename HashMap::value_type) + 2 * sizeof(void*)) + map.bucket_count() * sizeof(void*);
+}
+
+template <typename T>
+size_t EstimateVectorBytes(const std::vector<T>& vector) {
+    return vector.capacity() * sizeof(T);
+}
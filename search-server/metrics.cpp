@@ -0,0 +1,219 @@
+#include "metrics.h"
+#include <algorithm>
+#include <sstream>
+
+namespace {
+
+// Block of the registry the thread used last
+struct ThreadCache {
+    uint64_t serial = 0;
+    void* metrics = nullptr;
+};
+
+thread_local ThreadCache thread_cache;
+
+void AddRelaxed(std::atomic<uint64_t>& value, uint64_t delta) {
+    value.store(value.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+}  // namespace
+
+std::atomic<uint64_t> MetricsRegistry::next_serial_ = 1;
+
+uint64_t HistogramSnapshot::GetPercentile(double share) const {
+    if (count == 0) {
+        return 0;
+    }
+    const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(share * static_cast<double>(count) + 0.5));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return std::min(MetricsRegistry::GetBucketUpperBound(i), max);
+        }
+    }
+    return max;
+}
+
+std::string MetricsSnapshot::ToText() const {
+    std::ostringstream out;
+    for (const auto& [name, value] : counters) {
+        out << name << ' ' << value << '\n';
+    }
+    for (const HistogramSnapshot& histogram : histograms) {
+        out << histogram.name << " count=" << histogram.count << " sum_ns=" << histogram.sum
+            << " p50_ns=" << histogram.GetPercentile(0.5) << " p99_ns=" << histogram.GetPercentile(0.99)
+            << " max_ns=" << histogram.max << '\n';
+    }
+    return out.str();
+}
+
+std::string MetricsSnapshot::ToJson() const {
+    // Names are given by the code, they hold no characters to escape
+    std::ostringstream out;
+    out << "{\"counters\": {";
+    for (size_t i = 0; i < counters.size(); ++i) {
+        out << (i > 0 ? ", " : "") << '"' << counters[i].first << "\": " << counters[i].second;
+    }
+    out << "}, \"histograms\": {";
+    for (size_t i = 0; i < histograms.size(); ++i) {
+        const HistogramSnapshot& histogram = histograms[i];
+        out << (i > 0 ? ", " : "") << '"' << histogram.name << "\": {\"count\": " << histogram.count
+            << ", \"sum_ns\": " << histogram.sum << ", \"p50_ns\": " << histogram.GetPercentile(0.5)
+            << ", \"p99_ns\": " << histogram.GetPercentile(0.99) << ", \"max_ns\": " << histogram.max << '}';
+    }
+    out << "}}";
+    return out.str();
+}
+
+size_t MetricsRegistry::GetCounterId(std::string_view name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return GetMetricId(counter_names_, name, MAX_COUNTERS);
+}
+
+size_t MetricsRegistry::GetHistogramId(std::string_view name) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return GetMetricId(histogram_names_, name, MAX_HISTOGRAMS);
+}
+
+void MetricsRegistry::Add(size_t counter_id, uint64_t value) {
+    if (IsEnabled() && counter_id != NO_METRIC_ID) {
+        AddRelaxed(GetThreadMetrics().counters[counter_id], value);
+    }
+}
+
+void MetricsRegistry::Record(size_t histogram_id, uint64_t nanoseconds) {
+    if (!IsEnabled() || histogram_id == NO_METRIC_ID) {
+        return;
+    }
+    ThreadMetrics& metrics = GetThreadMetrics();
+    AddRelaxed(metrics.counts[histogram_id], 1);
+    AddRelaxed(metrics.sums[histogram_id], nanoseconds);
+    if (metrics.maxima[histogram_id].load(std::memory_order_relaxed) < nanoseconds) {
+        metrics.maxima[histogram_id].store(nanoseconds, std::memory_order_relaxed);
+    }
+    AddRelaxed(metrics.buckets[histogram_id][GetBucketIndex(nanoseconds)], 1);
+}
+
+void MetricsRegistry::SetEnabled(bool enabled) {
+    enabled_.store(enabled, std::memory_order_relaxed);
+}
+
+MetricsSnapshot MetricsRegistry::GetSnapshot() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    MetricsSnapshot snapshot;
+    for (size_t id = 0; id < counter_names_.size(); ++id) {
+        uint64_t value = 0;
+        for (const auto& [thread_id, metrics] : threads_) {
+            value += metrics->counters[id].load(std::memory_order_relaxed);
+        }
+        snapshot.counters.emplace_back(counter_names_[id], value);
+    }
+    for (size_t id = 0; id < histogram_names_.size(); ++id) {
+        HistogramSnapshot histogram;
+        histogram.name = histogram_names_[id];
+        histogram.buckets.assign(BUCKET_COUNT, 0);
+        for (const auto& [thread_id, metrics] : threads_) {
+            histogram.count += metrics->counts[id].load(std::memory_order_relaxed);
+            histogram.sum += metrics->sums[id].load(std::memory_order_relaxed);
+            histogram.max = std::max(histogram.max, metrics->maxima[id].load(std::memory_order_relaxed));
+            for (size_t bucket = 0; bucket < BUCKET_COUNT; ++bucket) {
+                histogram.buckets[bucket] += metrics->buckets[id][bucket].load(std::memory_order_relaxed);
+            }
+        }
+        snapshot.histograms.push_back(std::move(histogram));
+    }
+    return snapshot;
+}
+
+std::string MetricsRegistry::Export(MetricsFormat format) const {
+    const MetricsSnapshot snapshot = GetSnapshot();
+    return format == MetricsFormat::JSON ? snapshot.ToJson() : snapshot.ToText();
+}
+
+size_t MetricsRegistry::GetBucketIndex(uint64_t value) {
+    if (value < SUB_BUCKET_COUNT) {
+        return static_cast<size_t>(value);
+    }
+    int magnitude = 63;
+    while (((value >> magnitude) & 1) == 0) {
+        --magnitude;
+    }
+    if (magnitude >= MAX_MAGNITUDE) {
+        return BUCKET_COUNT - 1;
+    }
+    // The bits right after the leading one pick the bucket within the power of two
+    const size_t sub_bucket = (value >> (magnitude - SUB_BUCKET_BITS)) & (SUB_BUCKET_COUNT - 1);
+    return SUB_BUCKET_COUNT * static_cast<size_t>(magnitude - SUB_BUCKET_BITS + 1) + sub_bucket;
+}
+
+uint64_t MetricsRegistry::GetBucketUpperBound(size_t index) {
+    if (index < SUB_BUCKET_COUNT) {
+        return index;
+    }
+    if (index >= BUCKET_COUNT - 1) {
+        return UINT64_MAX;
+    }
+    const int shift = static_cast<int>(index / SUB_BUCKET_COUNT) - 1;
+    const uint64_t first = (SUB_BUCKET_COUNT + index % SUB_BUCKET_COUNT) << shift;
+    return first + (uint64_t{1} << shift) - 1;
+}
+
+MetricsRegistry::ThreadMetrics& MetricsRegistry::GetThreadMetrics() {
+    if (thread_cache.serial == serial_) {
+        return *static_cast<ThreadMetrics*>(thread_cache.metrics);
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unique_ptr<ThreadMetrics>& metrics = threads_[std::this_thread::get_id()];
+    if (metrics == nullptr) {
+        metrics = std::make_unique<ThreadMetrics>();
+    }
+    thread_cache = {serial_, metrics.get()};
+    return *metrics;
+}
+
+size_t MetricsRegistry::GetMetricId(std::deque<std::string>& names, std::string_view name, size_t max_count) {
+    const auto it = std::find(names.begin(), names.end(), name);
+    if (it != names.end()) {
+        return static_cast<size_t>(it - names.begin());
+    }
+    if (names.size() == max_count) {
+        return NO_METRIC_ID;
+    }
+    names.emplace_back(name);
+    return names.size() - 1;
+}
+
+MetricsRegistry& GetMetrics() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+ScopedTimer::ScopedTimer(size_t histogram_id, MetricsRegistry& registry)
+        : registry_(registry)
+        , histogram_id_(histogram_id)
+        , is_running_(registry.IsEnabled())
+        , start_(is_running_ ? Clock::now() : Clock::time_point{}) {
+}
+
+ScopedTimer::~ScopedTimer() {
+    Stop();
+}
+
+void ScopedTimer::Switch(size_t histogram_id) {
+    if (!is_running_) {
+        return;
+    }
+    const Clock::time_point now = Clock::now();
+    registry_.Record(histogram_id_, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now - start_).count()));
+    histogram_id_ = histogram_id;
+    start_ = now;
+}
+
+void ScopedTimer::Stop() {
+    if (!is_running_) {
+        return;
+    }
+    registry_.Record(histogram_id_, static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_).count()));
+    is_running_ = false;
+}
@@ -0,0 +1,143 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+enum class MetricsFormat {
+    TEXT,
+    JSON,
+};
+
+// Merged values of one latency histogram, in nanoseconds
+struct HistogramSnapshot {
+    std::string name;
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+    // Counts by bucket index, see MetricsRegistry::GetBucketIndex
+    std::vector<uint64_t> buckets;
+
+    // Upper bound of the bucket holding the given share of values, 0 for an empty histogram
+    uint64_t GetPercentile(double share) const;
+};
+
+struct MetricsSnapshot {
+    std::vector<std::pair<std::string, uint64_t>> counters;
+    std::vector<HistogramSnapshot> histograms;
+
+    std::string ToText() const;
+
+    std::string ToJson() const;
+};
+
+// Named counters and latency histograms. Every thread writes its own block of values with plain relaxed
+// stores, so recording takes no lock and no atomic read-modify-write. Readers add up the blocks of all
+// threads, blocks of finished threads are kept. Metrics are registered by name once and then used by id.
+// Histograms are HDR-style: values below 2^SUB_BUCKET_BITS get a bucket each, larger ones a bucket per
+// 1/2^SUB_BUCKET_BITS of their power of two, so every value is kept within about 6%.
+class MetricsRegistry {
+public:
+    static constexpr size_t MAX_COUNTERS = 64;
+    static constexpr size_t MAX_HISTOGRAMS = 32;
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr int SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS;
+    // Values from 2^MAX_MAGNITUDE ns, about 18 minutes, fall into the last bucket
+    static constexpr int MAX_MAGNITUDE = 40;
+    static constexpr size_t BUCKET_COUNT = SUB_BUCKET_COUNT * (MAX_MAGNITUDE - SUB_BUCKET_BITS + 1);
+    // Id given once all names are taken, values recorded under it are dropped
+    static constexpr size_t NO_METRIC_ID = SIZE_MAX;
+
+    MetricsRegistry() = default;
+
+    MetricsRegistry(const MetricsRegistry&) = delete;
+
+    MetricsRegistry& operator=(const MetricsRegistry&) = delete;
+
+    // Id of the metric with the name, registered on first request.
+    // NO_METRIC_ID once MAX_COUNTERS or MAX_HISTOGRAMS names are taken.
+    size_t GetCounterId(std::string_view name);
+
+    size_t GetHistogramId(std::string_view name);
+
+    void Add(size_t counter_id, uint64_t value = 1);
+
+    void Record(size_t histogram_id, uint64_t nanoseconds);
+
+    // Disabled registries ignore new values, timers do not even read the clock
+    void SetEnabled(bool enabled);
+
+    bool IsEnabled() const {
+        return enabled_.load(std::memory_order_relaxed);
+    }
+
+    MetricsSnapshot GetSnapshot() const;
+
+    std::string Export(MetricsFormat format) const;
+
+    static size_t GetBucketIndex(uint64_t value);
+
+    static uint64_t GetBucketUpperBound(size_t index);
+
+private:
+    // Written by its own thread only, read by snapshots
+    struct ThreadMetrics {
+        std::array<std::atomic<uint64_t>, MAX_COUNTERS> counters{};
+        std::array<std::atomic<uint64_t>, MAX_HISTOGRAMS> counts{};
+        std::array<std::atomic<uint64_t>, MAX_HISTOGRAMS> sums{};
+        std::array<std::atomic<uint64_t>, MAX_HISTOGRAMS> maxima{};
+        std::array<std::array<std::atomic<uint64_t>, BUCKET_COUNT>, MAX_HISTOGRAMS> buckets{};
+    };
+
+    // Tells registries apart in the per-thread cache of blocks, addresses may be reused
+    const uint64_t serial_ = next_serial_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic<bool> enabled_ = true;
+    mutable std::mutex mutex_;
+    std::deque<std::string> counter_names_;
+    std::deque<std::string> histogram_names_;
+    std::map<std::thread::id, std::unique_ptr<ThreadMetrics>> threads_;
+
+    static std::atomic<uint64_t> next_serial_;
+
+    ThreadMetrics& GetThreadMetrics();
+
+    static size_t GetMetricId(std::deque<std::string>& names, std::string_view name, size_t max_count);
+};
+
+// Registry of the whole process, the search server reports to it
+MetricsRegistry& GetMetrics();
+
+// Records the time from construction to destruction into a histogram. Switch closes the current stage
+// and starts timing the next one with the same clock reading, so back-to-back stages cost one reading each.
+class ScopedTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit ScopedTimer(size_t histogram_id, MetricsRegistry& registry = GetMetrics());
+
+    ScopedTimer(const ScopedTimer&) = delete;
+
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    ~ScopedTimer();
+
+    void Switch(size_t histogram_id);
+
+    // Records the current stage, nothing more is recorded afterwards
+    void Stop();
+
+private:
+    MetricsRegistry& registry_;
+    size_t histogram_id_;
+    bool is_running_;
+    Clock::time_point start_;
+};
@@ -0,0 +1,173 @@
+#include "position_index.h"
+#include <algorithm>
+#include <numeric>
+
+namespace {
+
+void EncodeVarint(uint32_t value, std::vector<uint8_t>& out) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+const uint8_t* DecodeVarint(const uint8_t* in, uint32_t& value) {
+    value = 0;
+    for (int shift = 0;; shift += 7) {
+        const uint8_t byte = *in++;
+        value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return in;
+        }
+    }
+}
+
+}  // namespace
+
+void PositionIndex::Add(int document_id, const std::vector<int>& word_ids) {
+    // Positions of every word come out ascending once the order is sorted stably by word id
+    std::vector<uint32_t> order(word_ids.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&word_ids](uint32_t lhs, uint32_t rhs) {
+        return word_ids[lhs] < word_ids[rhs];
+    });
+
+    Page& page = pages_.GetMutable(static_cast<size_t>(document_id) >> PAGE_BITS);
+    DocumentPositions document = {page.words.size(), 0, page.data.size(), 0};
+    uint32_t previous = 0;
+    for (const uint32_t position : order) {
+        const int word_id = word_ids[position];
+        if (document.word_count == 0 || page.words.back().word_id != word_id) {
+            page.words.push_back({word_id, 0, static_cast<uint32_t>(page.data.size() - document.data_offset)});
+            ++document.word_count;
+            previous = 0;
+        }
+        ++page.words.back().count;
+        EncodeVarint(position - previous, page.data);
+        previous = position;
+    }
+    document.data_size = page.data.size() - document.data_offset;
+    const auto it = LowerBoundId(page.documents, document_id);
+    if (it != page.documents.end() && it->first == document_id) {
+        page.hole_words += it->second.word_count;
+        page.hole_bytes += it->second.data_size;
+        it->second = document;
+    } else {
+        page.documents.emplace(it, document_id, document);
+    }
+}
+
+void PositionIndex::Remove(int document_id) {
+    if (!Contains(document_id)) {
+        return;
+    }
+    Page& page = pages_.GetMutable(static_cast<size_t>(document_id) >> PAGE_BITS);
+    const auto it = LowerBoundId(page.documents, document_id);
+    page.hole_words += it->second.word_count;
+    page.hole_bytes += it->second.data_size;
+    page.documents.erase(it);
+    if (page.hole_bytes * 2 > page.data.size()) {
+        page.Squeeze();
+    }
+}
+
+bool PositionIndex::Contains(int document_id) const {
+    const Page* page = pages_.Find(static_cast<size_t>(document_id) >> PAGE_BITS);
+    return page != nullptr && page->Find(document_id) != nullptr;
+}
+
+bool PositionIndex::ContainsPhrase(int document_id, const std::vector<int>& word_ids) const {
+    const Page* page = pages_.Find(static_cast<size_t>(document_id) >> PAGE_BITS);
+    const DocumentPositions* document = page == nullptr ? nullptr : page->Find(document_id);
+    if (document == nullptr) {
+        return false;
+    }
+    // starts holds the positions where the words so far occur in a row
+    std::vector<uint32_t> starts;
+    std::vector<uint32_t> positions;
+    for (size_t i = 0; i < word_ids.size(); ++i) {
+        if (!page->GetPositions(*document, word_ids[i], positions)) {
+            return false;
+        }
+        if (i == 0) {
+            starts.swap(positions);
+            continue;
+        }
+        auto position = positions.begin();
+        starts.erase(std::remove_if(starts.begin(), starts.end(),
+                                    [&](uint32_t start) {
+                                        const uint32_t expected = start + static_cast<uint32_t>(i);
+                                        position = std::lower_bound(position, positions.end(), expected);
+                                        return position == positions.end() || *position != expected;
+                                    }),
+                     starts.end());
+        if (starts.empty()) {
+            return false;
+        }
+    }
+    return !starts.empty();
+}
+
+void PositionIndex::RenumberWords(const std::vector<int>& new_word_ids) {
+    for (size_t position = 0; position < pages_.GetPageCount(); ++position) {
+        Page& page = pages_.GetMutablePage(position);
+        page.Squeeze();
+        for (WordPositions& word : page.words) {
+            word.word_id = new_word_ids[word.word_id];
+        }
+    }
+}
+
+size_t PositionIndex::GetMemoryBytes() const {
+    return pages_.GetMemoryBytes([](const Page& page) {
+        return EstimateVectorBytes(page.words) + EstimateVectorBytes(page.data) + EstimateVectorBytes(page.documents);
+    });
+}
+
+const PositionIndex::DocumentPositions* PositionIndex::Page::Find(int document_id) const {
+    const auto it = LowerBoundId(documents, document_id);
+    return it != documents.end() && it->first == document_id ? &it->second : nullptr;
+}
+
+bool PositionIndex::Page::GetPositions(const DocumentPositions& document, int word_id,
+                                       std::vector<uint32_t>& positions) const {
+    const auto first = words.begin() + static_cast<std::ptrdiff_t>(document.first_word);
+    const auto last = first + static_cast<std::ptrdiff_t>(document.word_count);
+    const auto word = std::lower_bound(first, last, word_id, [](const WordPositions& entry, int id) {
+        return entry.word_id < id;
+    });
+    if (word == last || word->word_id != word_id) {
+        return false;
+    }
+    positions.resize(word->count);
+    const uint8_t* in = data.data() + document.data_offset + word->offset;
+    uint32_t position = 0;
+    for (uint32_t& value : positions) {
+        uint32_t gap;
+        in = DecodeVarint(in, gap);
+        position += gap;
+        value = position;
+    }
+    return true;
+}
+
+void PositionIndex::Page::Squeeze() {
+    std::vector<WordPositions> squeezed_words;
+    std::vector<uint8_t> squeezed_data;
+    squeezed_words.reserve(words.size() - hole_words);
+    squeezed_data.reserve(data.size() - hole_bytes);
+    for (auto& [document_id, document] : documents) {
+        const auto first_word = words.begin() + static_cast<std::ptrdiff_t>(document.first_word);
+        const auto first_byte = data.begin() + static_cast<std::ptrdiff_t>(document.data_offset);
+        document.first_word = squeezed_words.size();
+        document.data_offset = squeezed_data.size();
+        squeezed_words.insert(squeezed_words.end(), first_word,
+                              first_word + static_cast<std::ptrdiff_t>(document.word_count));
+        squeezed_data.insert(squeezed_data.end(), first_byte, first_byte + static_cast<std::ptrdiff_t>(document.data_size));
+    }
+    words = std::move(squeezed_words);
+    data = std::move(squeezed_data);
+    hole_words = 0;
+    hole_bytes = 0;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "memory_stats.h"
+#include "shared_pages.h"
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Positions of the words of every document, counted after stop words are dropped. Positions of a word
+// in a document are stored as varint-coded gaps, the words of a document are sorted by id like in ForwardIndex.
+// Documents of 2^PAGE_BITS consecutive ids share a page with one byte array of positions, copies of the index
+// share the pages they did not change. Removed documents leave holes that are squeezed once they take half of a page.
+class PositionIndex {
+public:
+    static constexpr int PAGE_BITS = 8;
+
+    // Word ids of the document in text order
+    void Add(int document_id, const std::vector<int>& word_ids);
+
+    void Remove(int document_id);
+
+    bool Contains(int document_id) const;
+
+    // True if the words occur in the document one right after another
+    bool ContainsPhrase(int document_id, const std::vector<int>& word_ids) const;
+
+    // Moves the words to new_word_ids[word_id], new ids must keep the order of the words of a document
+    void RenumberWords(const std::vector<int>& new_word_ids);
+
+    size_t GetMemoryBytes() const;
+
+private:
+    // Positions of one word, offset is relative to the data of its document
+    struct WordPositions {
+        int word_id;
+        uint32_t count;
+        uint32_t offset;
+    };
+
+    struct DocumentPositions {
+        size_t first_word;
+        size_t word_count;
+        size_t data_offset;
+        size_t data_size;
+    };
+
+    struct Page {
+        std::vector<WordPositions> words;
+        std::vector<uint8_t> data;
+        // Sorted by document id
+        std::vector<std::pair<int, DocumentPositions>> documents;
+        size_t hole_words = 0;
+        size_t hole_bytes = 0;
+
+        const DocumentPositions* Find(int document_id) const;
+
+        // Decodes the positions of the word into positions, false if the document does not have the word
+        bool GetPositions(const DocumentPositions& document, int word_id, std::vector<uint32_t>& positions) const;
+
+        // Drops the holes and trims the arrays to their size
+        void Squeeze();
+    };
+
+    SharedPages<Page> pages_;
+};
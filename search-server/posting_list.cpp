@@ -0,0 +1,483 @@
+#include "posting_list.h"
+#include <algorithm>
+#include <iterator>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SEARCH_SERVER_SSSE3
+#include <immintrin.h>
+#endif
+
+namespace {
+
+// Shuffle masks that spread the bytes of four StreamVByte numbers over four 32-bit lanes, indexed by control byte
+struct StreamVByteTables {
+    uint8_t shuffles[256][16];
+    uint8_t lengths[256];
+};
+
+StreamVByteTables BuildTables() {
+    StreamVByteTables tables;
+    for (int control = 0; control < 256; ++control) {
+        uint8_t position = 0;
+        for (int lane = 0; lane < 4; ++lane) {
+            const int length = ((control >> (2 * lane)) & 3) + 1;
+            for (int byte = 0; byte < 4; ++byte) {
+                // A mask byte with the high bit set makes the shuffle write zero
+                tables.shuffles[control][lane * 4 + byte] = byte < length ? position++ : 0x80;
+            }
+        }
+        tables.lengths[control] = position;
+    }
+    return tables;
+}
+
+const StreamVByteTables& GetTables() {
+    static const StreamVByteTables tables = BuildTables();
+    return tables;
+}
+
+void EncodeNumbers(const uint32_t* values, size_t count, std::vector<uint8_t>& out) {
+    const size_t control_start = out.size();
+    out.resize(control_start + (count + 3) / 4, 0);
+    for (size_t i = 0; i < count; ++i) {
+        const uint32_t value = values[i];
+        const int length = value < (1u << 8) ? 1 : value < (1u << 16) ? 2 : value < (1u << 24) ? 3 : 4;
+        out[control_start + i / 4] |= static_cast<uint8_t>((length - 1) << (2 * (i % 4)));
+        for (int byte = 0; byte < length; ++byte) {
+            out.push_back(static_cast<uint8_t>(value >> (8 * byte)));
+        }
+    }
+}
+
+// Decodes whole groups of four numbers while 16 bytes can be loaded before end, returns the number decoded
+using DecodeGroupsFunction = size_t (*)(const uint8_t* control, const uint8_t*& data, const uint8_t* end,
+                                        size_t count, uint32_t* out);
+
+#ifdef SEARCH_SERVER_SSSE3
+__attribute__((target("ssse3")))
+size_t DecodeGroupsSsse3(const uint8_t* control, const uint8_t*& data, const uint8_t* end, size_t count, uint32_t* out) {
+    const StreamVByteTables& tables = GetTables();
+    size_t i = 0;
+    for (; i + 4 <= count && end - data >= 16; i += 4) {
+        const uint8_t code = control[i / 4];
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+        const __m128i shuffle = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tables.shuffles[code]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_shuffle_epi8(bytes, shuffle));
+        data += tables.lengths[code];
+    }
+    return i;
+}
+#endif
+
+DecodeGroupsFunction SelectDecodeGroups() {
+#ifdef SEARCH_SERVER_SSSE3
+    if (__builtin_cpu_supports("ssse3")) {
+        return DecodeGroupsSsse3;
+    }
+#endif
+    return nullptr;
+}
+
+// Decodes count numbers of a block that starts with its control bytes and ends at end
+void DecodeNumbers(const uint8_t* block, const uint8_t* end, size_t count, uint32_t* out) {
+    static const DecodeGroupsFunction decode_groups = SelectDecodeGroups();
+    const uint8_t* control = block;
+    const uint8_t* data = block + (count + 3) / 4;
+    size_t i = decode_groups == nullptr ? 0 : decode_groups(control, data, end, count, out);
+    for (; i < count; ++i) {
+        const int length = ((control[i / 4] >> (2 * (i % 4))) & 3) + 1;
+        uint32_t value = 0;
+        for (int byte = 0; byte < length; ++byte) {
+            value |= static_cast<uint32_t>(data[byte]) << (8 * byte);
+        }
+        data += length;
+        out[i] = value;
+    }
+}
+
+// Appends one block holding entries [0, count) to data
+PostingBlock EncodeBlock(const PostingEntry* entries, size_t count, std::vector<uint8_t>& data) {
+    uint32_t values[2 * PostingList::BLOCK_SIZE];
+    PostingBlock block = {entries[0].document_id, entries[count - 1].document_id, data.size(), 0,
+                          static_cast<uint32_t>(count), 0.0};
+    int previous_id = entries[0].document_id;
+    for (size_t i = 0; i < count; ++i) {
+        values[i] = static_cast<uint32_t>(entries[i].document_id - previous_id);
+        values[count + i] = static_cast<uint32_t>(entries[i].occurrences);
+        previous_id = entries[i].document_id;
+        block.max_term_freq = std::max(block.max_term_freq, entries[i].GetTermFreq());
+    }
+    EncodeNumbers(values, 2 * count, data);
+    block.size = static_cast<uint32_t>(data.size() - block.offset);
+    return block;
+}
+
+bool HasLowerId(const PostingEntry& entry, int document_id) {
+    return entry.document_id < document_id;
+}
+
+const std::vector<PostingEntry> NO_TAIL;
+
+}  // namespace
+
+PostingList::PostingList(const PostingList& other)
+        : borrowed_blocks_(other.borrowed_blocks_)
+        , borrowed_data_(other.borrowed_data_)
+        , borrowed_block_count_(other.borrowed_block_count_)
+        , size_(other.size_)
+        , max_term_freq_(other.max_term_freq_)
+        , owned_(other.owned_ ? std::make_unique<OwnedPostings>(*other.owned_) : nullptr) {
+}
+
+PostingList& PostingList::operator=(const PostingList& other) {
+    if (this != &other) {
+        *this = PostingList(other);
+    }
+    return *this;
+}
+
+PostingList PostingList::Borrow(const PostingBlock* blocks, size_t block_count, const uint8_t* data,
+                                size_t size, double max_term_freq) {
+    PostingList postings;
+    postings.borrowed_blocks_ = blocks;
+    postings.borrowed_block_count_ = static_cast<uint32_t>(block_count);
+    postings.borrowed_data_ = data;
+    postings.size_ = static_cast<uint32_t>(size);
+    postings.max_term_freq_ = max_term_freq;
+    return postings;
+}
+
+bool PostingList::IsBorrowed() const {
+    return owned_ == nullptr;
+}
+
+size_t PostingList::size() const {
+    return size_;
+}
+
+bool PostingList::empty() const {
+    return size_ == 0;
+}
+
+double PostingList::GetMaxTermFreq() const {
+    return max_term_freq_;
+}
+
+size_t PostingList::GetBlockCount() const {
+    return GetSealedBlockCount() + (GetTail().empty() ? 0 : 1);
+}
+
+int PostingList::GetBlockFirstId(size_t block) const {
+    return block < GetSealedBlockCount() ? GetSealedBlocks()[block].first_document_id : GetTail().front().document_id;
+}
+
+int PostingList::GetBlockLastId(size_t block) const {
+    return block < GetSealedBlockCount() ? GetSealedBlocks()[block].last_document_id : GetTail().back().document_id;
+}
+
+size_t PostingList::FindBlock(int64_t document_id) const {
+    const PostingBlock* first = GetSealedBlocks();
+    const PostingBlock* last = first + GetSealedBlockCount();
+    const PostingBlock* it = std::lower_bound(first, last, document_id,
+                                              [](const PostingBlock& block, int64_t id) {
+                                                  return block.last_document_id < id;
+                                              });
+    if (it != last) {
+        return static_cast<size_t>(it - first);
+    }
+    const std::vector<PostingEntry>& tail = GetTail();
+    if (!tail.empty() && tail.back().document_id >= document_id) {
+        return GetSealedBlockCount();
+    }
+    return GetBlockCount();
+}
+
+size_t PostingList::DecodeBlock(size_t block, const DocumentLengths& lengths, Posting* out) const {
+    if (block == GetSealedBlockCount()) {
+        const std::vector<PostingEntry>& tail = GetTail();
+        for (size_t i = 0; i < tail.size(); ++i) {
+            out[i] = {tail[i].document_id, tail[i].GetTermFreq()};
+        }
+        return tail.size();
+    }
+    int document_ids[BLOCK_SIZE];
+    uint32_t values[2 * BLOCK_SIZE];
+    uint32_t document_lengths[BLOCK_SIZE];
+    const size_t count = DecodeSealedBlock(block, document_ids, values);
+    lengths.Get(document_ids, count, document_lengths);
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = {document_ids[i], static_cast<double>(values[count + i]) / static_cast<double>(document_lengths[i])};
+    }
+    return count;
+}
+
+size_t PostingList::DecodeEntries(size_t block, const DocumentLengths& lengths, PostingEntry* out) const {
+    if (block == GetSealedBlockCount()) {
+        const std::vector<PostingEntry>& tail = GetTail();
+        std::copy(tail.begin(), tail.end(), out);
+        return tail.size();
+    }
+    int document_ids[BLOCK_SIZE];
+    uint32_t values[2 * BLOCK_SIZE];
+    uint32_t document_lengths[BLOCK_SIZE];
+    const size_t count = DecodeSealedBlock(block, document_ids, values);
+    lengths.Get(document_ids, count, document_lengths);
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = {document_ids[i], static_cast<int>(values[count + i]), static_cast<int>(document_lengths[i])};
+    }
+    return count;
+}
+
+bool PostingList::Contains(int document_id) const {
+    const size_t block = FindBlock(document_id);
+    if (block == GetBlockCount() || GetBlockFirstId(block) > document_id) {
+        return false;
+    }
+    if (block == GetSealedBlockCount()) {
+        return std::binary_search(GetTail().begin(), GetTail().end(), PostingEntry{document_id, 0, 0},
+                                  [](const PostingEntry& lhs, const PostingEntry& rhs) {
+                                      return lhs.document_id < rhs.document_id;
+                                  });
+    }
+    int document_ids[BLOCK_SIZE];
+    uint32_t values[2 * BLOCK_SIZE];
+    const size_t count = DecodeSealedBlock(block, document_ids, values);
+    return std::binary_search(document_ids, document_ids + count, document_id);
+}
+
+void PostingList::Insert(const PostingEntry& entry, const DocumentLengths& lengths) {
+    MakeOwned();
+    ++size_;
+    max_term_freq_ = std::max(max_term_freq_, entry.GetTermFreq());
+    const size_t sealed_count = GetSealedBlockCount();
+    std::vector<PostingEntry>& tail = owned_->tail;
+    // Ids usually grow, so the tail takes most insertions
+    if (sealed_count == 0 || entry.document_id > GetSealedBlocks()[sealed_count - 1].last_document_id) {
+        tail.insert(std::lower_bound(tail.begin(), tail.end(), entry.document_id, HasLowerId), entry);
+        if (tail.size() == BLOCK_SIZE) {
+            ReplaceBlocks(sealed_count, sealed_count, tail.data(), tail.size());
+            tail.clear();
+        }
+        return;
+    }
+    const size_t block = FindBlock(entry.document_id);
+    PostingEntry entries[BLOCK_SIZE + 1];
+    const size_t count = DecodeEntries(block, lengths, entries);
+    PostingEntry* position = std::lower_bound(entries, entries + count, entry.document_id, HasLowerId);
+    std::copy_backward(position, entries + count, entries + count + 1);
+    *position = entry;
+    ReplaceBlocks(block, block + 1, entries, count + 1);
+}
+
+void PostingList::Erase(int document_id, const DocumentLengths& lengths) {
+    const size_t block = FindBlock(document_id);
+    if (block == GetBlockCount()) {
+        return;
+    }
+    double term_freq = 0.0;
+    if (block == GetSealedBlockCount()) {
+        std::vector<PostingEntry>& tail = owned_->tail;
+        const auto it = std::lower_bound(tail.begin(), tail.end(), document_id, HasLowerId);
+        if (it == tail.end() || it->document_id != document_id) {
+            return;
+        }
+        term_freq = it->GetTermFreq();
+        tail.erase(it);
+    } else {
+        PostingEntry entries[BLOCK_SIZE];
+        const size_t count = DecodeEntries(block, lengths, entries);
+        PostingEntry* position = std::lower_bound(entries, entries + count, document_id, HasLowerId);
+        if (position == entries + count || position->document_id != document_id) {
+            return;
+        }
+        term_freq = position->GetTermFreq();
+        std::copy(position + 1, entries + count, position);
+        ReplaceBlocks(block, block + 1, entries, count - 1);
+    }
+    --size_;
+    if (term_freq >= max_term_freq_) {
+        UpdateMaxTermFreq();
+    }
+}
+
+void PostingList::Merge(const std::vector<PostingEntry>& entries, const DocumentLengths& lengths) {
+    if (entries.empty()) {
+        return;
+    }
+    if (empty() || entries.front().document_id > GetBlockLastId(GetBlockCount() - 1)) {
+        for (const PostingEntry& entry : entries) {
+            Insert(entry, lengths);
+        }
+        return;
+    }
+    // Ids interleave with the stored ones, the whole list is rebuilt
+    std::vector<PostingEntry> stored(size_);
+    size_t stored_count = 0;
+    for (size_t block = 0; block < GetBlockCount(); ++block) {
+        stored_count += DecodeEntries(block, lengths, stored.data() + stored_count);
+    }
+    std::vector<PostingEntry> merged;
+    merged.reserve(stored.size() + entries.size());
+    std::merge(stored.begin(), stored.end(), entries.begin(), entries.end(), std::back_inserter(merged),
+               [](const PostingEntry& lhs, const PostingEntry& rhs) {
+                   return lhs.document_id < rhs.document_id;
+               });
+    ReplaceBlocks(0, GetSealedBlockCount(), merged.data(), merged.size());
+    owned_->tail.clear();
+    size_ = static_cast<uint32_t>(merged.size());
+    UpdateMaxTermFreq();
+}
+
+size_t PostingList::GetMemoryBytes() const {
+    if (!owned_) {
+        return 0;
+    }
+    return sizeof(OwnedPostings) + owned_->blocks.capacity() * sizeof(PostingBlock) + owned_->data.capacity()
+           + owned_->tail.capacity() * sizeof(PostingEntry);
+}
+
+void PostingList::Encode(std::vector<PostingBlock>& blocks, std::vector<uint8_t>& data) const {
+    const size_t data_begin = data.size();
+    const PostingBlock* sealed_blocks = GetSealedBlocks();
+    const size_t sealed_count = GetSealedBlockCount();
+    blocks.insert(blocks.end(), sealed_blocks, sealed_blocks + sealed_count);
+    if (sealed_count > 0) {
+        const PostingBlock& last = sealed_blocks[sealed_count - 1];
+        data.insert(data.end(), GetData(), GetData() + last.offset + last.size);
+    }
+    const std::vector<PostingEntry>& tail = GetTail();
+    if (!tail.empty()) {
+        PostingBlock block = EncodeBlock(tail.data(), tail.size(), data);
+        block.offset -= data_begin;
+        blocks.push_back(block);
+    }
+}
+
+const PostingBlock* PostingList::GetSealedBlocks() const {
+    return owned_ ? owned_->blocks.data() : borrowed_blocks_;
+}
+
+size_t PostingList::GetSealedBlockCount() const {
+    return owned_ ? owned_->blocks.size() : borrowed_block_count_;
+}
+
+const uint8_t* PostingList::GetData() const {
+    return owned_ ? owned_->data.data() : borrowed_data_;
+}
+
+const std::vector<PostingEntry>& PostingList::GetTail() const {
+    return owned_ ? owned_->tail : NO_TAIL;
+}
+
+size_t PostingList::DecodeSealedBlock(size_t block, int* document_ids, uint32_t* values) const {
+    const PostingBlock& meta = GetSealedBlocks()[block];
+    const size_t count = meta.count;
+    const uint8_t* data = GetData() + meta.offset;
+    DecodeNumbers(data, data + meta.size, 2 * count, values);
+    int document_id = meta.first_document_id;
+    for (size_t i = 0; i < count; ++i) {
+        document_id += static_cast<int>(values[i]);
+        document_ids[i] = document_id;
+    }
+    return count;
+}
+
+void PostingList::ReplaceBlocks(size_t first, size_t last, const PostingEntry* entries, size_t count) {
+    MakeOwned();
+    std::vector<PostingBlock>& owned_blocks = owned_->blocks;
+    std::vector<uint8_t>& owned_data = owned_->data;
+    // Entries are spread evenly, so a block split in two gets two half-full blocks
+    std::vector<PostingBlock> blocks;
+    std::vector<uint8_t> data;
+    const size_t block_count = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    for (size_t i = 0; i < block_count; ++i) {
+        const size_t begin = count * i / block_count;
+        const size_t end = count * (i + 1) / block_count;
+        blocks.push_back(EncodeBlock(entries + begin, end - begin, data));
+    }
+
+    const uint64_t data_begin = first < owned_blocks.size() ? owned_blocks[first].offset : owned_data.size();
+    const uint64_t data_end = last > first ? owned_blocks[last - 1].offset + owned_blocks[last - 1].size : data_begin;
+    owned_data.erase(owned_data.begin() + data_begin, owned_data.begin() + data_end);
+    owned_data.insert(owned_data.begin() + data_begin, data.begin(), data.end());
+    for (PostingBlock& block : blocks) {
+        block.offset += data_begin;
+    }
+    for (size_t i = last; i < owned_blocks.size(); ++i) {
+        owned_blocks[i].offset = owned_blocks[i].offset - data_end + data_begin + data.size();
+    }
+    owned_blocks.erase(owned_blocks.begin() + first, owned_blocks.begin() + last);
+    owned_blocks.insert(owned_blocks.begin() + first, blocks.begin(), blocks.end());
+}
+
+void PostingList::MakeOwned() {
+    if (owned_) {
+        return;
+    }
+    owned_ = std::make_unique<OwnedPostings>();
+    owned_->blocks.assign(borrowed_blocks_, borrowed_blocks_ + borrowed_block_count_);
+    if (!owned_->blocks.empty()) {
+        owned_->data.assign(borrowed_data_, borrowed_data_ + owned_->blocks.back().offset + owned_->blocks.back().size);
+    }
+    borrowed_blocks_ = nullptr;
+    borrowed_data_ = nullptr;
+    borrowed_block_count_ = 0;
+}
+
+void PostingList::UpdateMaxTermFreq() {
+    max_term_freq_ = 0.0;
+    for (size_t block = 0; block < GetSealedBlockCount(); ++block) {
+        max_term_freq_ = std::max(max_term_freq_, GetSealedBlocks()[block].max_term_freq);
+    }
+    for (const PostingEntry& entry : GetTail()) {
+        max_term_freq_ = std::max(max_term_freq_, entry.GetTermFreq());
+    }
+}
+
+PostingCursor::PostingCursor(const PostingList& postings, const DocumentLengths& lengths, int64_t first_id,
+                             int64_t last_id)
+        : postings_(&postings)
+        , lengths_(&lengths)
+        , last_id_(last_id)
+        , block_(postings.FindBlock(first_id)) {
+    LoadBlock(block_);
+    while (!IsEnd() && Get().document_id < first_id) {
+        ++position_;
+    }
+    Settle();
+}
+
+void PostingCursor::Next() {
+    ++position_;
+    Settle();
+}
+
+void PostingCursor::SeekTo(int64_t document_id) {
+    if (IsEnd() || Get().document_id >= document_id) {
+        return;
+    }
+    if (document_id > buffer_[count_ - 1].document_id) {
+        block_ = postings_->FindBlock(document_id);
+        LoadBlock(block_);
+    }
+    position_ = static_cast<size_t>(std::lower_bound(buffer_ + position_, buffer_ + count_, document_id,
+                                                     [](const Posting& posting, int64_t id) {
+                                                         return posting.document_id < id;
+                                                     }) - buffer_);
+    Settle();
+}
+
+void PostingCursor::LoadBlock(size_t block) {
+    position_ = 0;
+    count_ = block < postings_->GetBlockCount() ? postings_->DecodeBlock(block, *lengths_, buffer_) : 0;
+}
+
+void PostingCursor::Settle() {
+    while (position_ == count_ && block_ < postings_->GetBlockCount()) {
+        LoadBlock(++block_);
+    }
+    if (!IsEnd() && Get().document_id >= last_id_) {
+        position_ = count_ = 0;
+        block_ = postings_->GetBlockCount();
+    }
+}
@@ -0,0 +1,202 @@
+#pragma once
+#include "document_lengths.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// One decoded entry of an inverted index posting list, postings are kept sorted by document_id
+struct Posting {
+    int document_id;
+    double term_freq;
+};
+
+// A posting as it is stored. The term frequency is kept exactly, as the number of occurrences
+// of the word divided by the number of words in the document. Encoded blocks keep the occurrences only,
+// the document length comes from the DocumentLengths of the segment when a block is decoded.
+struct PostingEntry {
+    int document_id;
+    int occurrences;
+    int document_length;
+
+    double GetTermFreq() const {
+        return static_cast<double>(occurrences) / static_cast<double>(document_length);
+    }
+};
+
+// Skip metadata of one compressed block, offset is relative to the data of its list
+struct PostingBlock {
+    int first_document_id;
+    int last_document_id;
+    uint64_t offset;
+    uint32_t size;
+    uint32_t count;
+    double max_term_freq;
+};
+
+// Postings of one word, compressed in blocks of at most BLOCK_SIZE postings.
+// A block stores document id deltas and occurrences as StreamVByte numbers:
+// a control byte holds 2-bit byte lengths of four numbers, the numbers follow in 1 to 4 bytes each,
+// so four numbers decode with one SIMD shuffle. Readers skip whole blocks by their first and last ids.
+// Postings with the largest ids gather in an uncompressed tail until it fills a block.
+// A list may borrow its blocks from a loaded index snapshot or from the storage of a sealed segment,
+// they are copied on the first change. Blocks and tail of a changed list are allocated apart,
+// so a borrowed list takes little more than its pointers.
+// Methods decoding term frequencies or re-encoding blocks take the lengths of the documents of the list.
+class PostingList {
+public:
+    static constexpr size_t BLOCK_SIZE = 128;
+
+    PostingList() = default;
+
+    PostingList(const PostingList& other);
+
+    PostingList& operator=(const PostingList& other);
+
+    PostingList(PostingList&&) = default;
+
+    PostingList& operator=(PostingList&&) = default;
+
+    static PostingList Borrow(const PostingBlock* blocks, size_t block_count, const uint8_t* data,
+                              size_t size, double max_term_freq);
+
+    // True if the list has no blocks or tail of its own
+    bool IsBorrowed() const;
+
+    size_t size() const;
+
+    bool empty() const;
+
+    double GetMaxTermFreq() const;
+
+    // Blocks go in ascending order of ids, the tail counts as the last block
+    size_t GetBlockCount() const;
+
+    int GetBlockFirstId(size_t block) const;
+
+    int GetBlockLastId(size_t block) const;
+
+    // Index of the first block whose last id is not less than document_id, GetBlockCount() if none
+    size_t FindBlock(int64_t document_id) const;
+
+    // Decodes a block into out, which must have room for BLOCK_SIZE postings, returns the number of postings
+    size_t DecodeBlock(size_t block, const DocumentLengths& lengths, Posting* out) const;
+
+    // Decodes a block as it is stored, with occurrences and document lengths, out must have room for BLOCK_SIZE entries
+    size_t DecodeEntries(size_t block, const DocumentLengths& lengths, PostingEntry* out) const;
+
+    bool Contains(int document_id) const;
+
+    // Calls function(posting) for postings with first_id <= document_id < last_id in ascending order of ids
+    template <typename Function>
+    void ForEach(const DocumentLengths& lengths, int64_t first_id, int64_t last_id, Function function) const;
+
+    template <typename Function>
+    void ForEach(const DocumentLengths& lengths, Function function) const;
+
+    void Insert(const PostingEntry& entry, const DocumentLengths& lengths);
+
+    void Erase(int document_id, const DocumentLengths& lengths);
+
+    // Adds postings sorted by id, none of the ids may be in the list already
+    void Merge(const std::vector<PostingEntry>& entries, const DocumentLengths& lengths);
+
+    // Appends the compressed form of the whole list, the tail encoded as one more block.
+    // Offsets of the appended blocks are relative to the first appended byte.
+    void Encode(std::vector<PostingBlock>& blocks, std::vector<uint8_t>& data) const;
+
+    // Heap bytes of the list, borrowed blocks are not counted
+    size_t GetMemoryBytes() const;
+
+private:
+    struct OwnedPostings {
+        std::vector<PostingBlock> blocks;
+        std::vector<uint8_t> data;
+        std::vector<PostingEntry> tail;
+    };
+
+    const PostingBlock* borrowed_blocks_ = nullptr;
+    const uint8_t* borrowed_data_ = nullptr;
+    uint32_t borrowed_block_count_ = 0;
+    uint32_t size_ = 0;
+    double max_term_freq_ = 0.0;
+    // Blocks and tail of a list changed since it was borrowed, nullptr for a borrowed list
+    std::unique_ptr<OwnedPostings> owned_;
+
+    const PostingBlock* GetSealedBlocks() const;
+
+    size_t GetSealedBlockCount() const;
+
+    const uint8_t* GetData() const;
+
+    const std::vector<PostingEntry>& GetTail() const;
+
+    // Decodes the ids of a sealed block into document_ids and its numbers into values, the occurrences
+    // start at values + count. Returns the number of postings count.
+    size_t DecodeSealedBlock(size_t block, int* document_ids, uint32_t* values) const;
+
+    // Replaces sealed blocks [first, last) with blocks encoding count entries
+    void ReplaceBlocks(size_t first, size_t last, const PostingEntry* entries, size_t count);
+
+    void MakeOwned();
+
+    void UpdateMaxTermFreq();
+};
+
+// Walks the postings of a list with first_id <= document_id < last_id, decoding one block at a time
+class PostingCursor {
+public:
+    PostingCursor(const PostingList& postings, const DocumentLengths& lengths, int64_t first_id, int64_t last_id);
+
+    bool IsEnd() const {
+        return position_ == count_;
+    }
+
+    const Posting& Get() const {
+        return buffer_[position_];
+    }
+
+    void Next();
+
+    // Moves to the first posting with an id not less than document_id, blocks in between are not decoded
+    void SeekTo(int64_t document_id);
+
+private:
+    const PostingList* postings_;
+    const DocumentLengths* lengths_;
+    int64_t last_id_;
+    size_t block_;
+    size_t count_ = 0;
+    size_t position_ = 0;
+    Posting buffer_[PostingList::BLOCK_SIZE];
+
+    void LoadBlock(size_t block);
+
+    // Loads next blocks while the current one is used up, stops at last_id_
+    void Settle();
+};
+
+template <typename Function>
+void PostingList::ForEach(const DocumentLengths& lengths, int64_t first_id, int64_t last_id, Function function) const {
+    Posting buffer[BLOCK_SIZE];
+    const size_t block_count = GetBlockCount();
+    for (size_t block = FindBlock(first_id); block < block_count && GetBlockFirstId(block) < last_id; ++block) {
+        const size_t count = DecodeBlock(block, lengths, buffer);
+        for (size_t i = 0; i < count; ++i) {
+            if (buffer[i].document_id >= first_id && buffer[i].document_id < last_id) {
+                function(buffer[i]);
+            }
+        }
+    }
+}
+
+template <typename Function>
+void PostingList::ForEach(const DocumentLengths& lengths, Function function) const {
+    Posting buffer[BLOCK_SIZE];
+    for (size_t block = 0; block < GetBlockCount(); ++block) {
+        const size_t count = DecodeBlock(block, lengths, buffer);
+        for (size_t i = 0; i < count; ++i) {
+            function(buffer[i]);
+        }
+    }
+}
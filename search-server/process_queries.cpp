@@ -1,32 +1,38 @@
 #include "process_queries.h"
-#include <numeric>
-#include <execution>
 
-std::vector<std::vector<Document>> ProcessQueries(
+QueryBatchResult ProcessQueriesBatch(
     const SearchServer& search_server,
     const std::vector<std::string>& queries) {
-    std::vector<std::vector<Document>> queriesResult(queries.size());
-
-    std::transform(std::execution::par,
-        queries.begin(), queries.end(),
-        queriesResult.begin(),
-        [&search_server](std::string query) {
-            return search_server.FindTopDocuments(query);
-        }
-    );
-
-    return queriesResult;
+    return search_server.FindTopDocumentsBatch(queries);
 }
 
-std::list<Document> ProcessQueriesJoined(
+std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries) {
-    auto topDocuments = ProcessQueries(search_server, queries);
-    std::list<Document> queriesResult;
-    for (auto x : topDocuments) {
-        for (auto z : x) {
-            queriesResult.push_back(z);
-        }
+    const QueryBatchResult batch = ProcessQueriesBatch(search_server, queries);
+    std::vector<std::vector<Document>> queriesResult;
+    queriesResult.reserve(batch.GetQueryCount());
+    for (size_t i = 0; i < batch.GetQueryCount(); ++i) {
+        const auto documents = batch.GetDocuments(i);
+        queriesResult.emplace_back(documents.begin(), documents.end());
     }
     return queriesResult;
-}
\ No newline at end of file
+}
+
+std::vector<Document> ProcessQueriesJoined(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries) {
+    return ProcessQueriesBatch(search_server, queries).documents;
+}
+
+std::vector<std::vector<Document>> ProcessQueries(
+    const ConcurrentSearchServer& search_server,
+    const std::vector<std::string>& queries) {
+    return ProcessQueries(*search_server.GetSnapshot(), queries);
+}
+
+std::vector<Document> ProcessQueriesJoined(
+    const ConcurrentSearchServer& search_server,
+    const std::vector<std::string>& queries) {
+    return ProcessQueriesJoined(*search_server.GetSnapshot(), queries);
+}
@@ -1,11 +1,25 @@
 #pragma once
 #include "search_server.h"
-#include <list>
+#include "concurrent_search_server.h"
+#include "query_batch.h"
+
+QueryBatchResult ProcessQueriesBatch(
+    const SearchServer& search_server,
+    const std::vector<std::string>& queries);
 
 std::vector<std::vector<Document>> ProcessQueries(
     const SearchServer& search_server,
     const std::vector<std::string>& queries);
 
-std::list<Document> ProcessQueriesJoined(
+std::vector<Document> ProcessQueriesJoined(
     const SearchServer& search_server,
-    const std::vector<std::string>& queries);
\ No newline at end of file
+    const std::vector<std::string>& queries);
+
+// All queries of the batch are answered by one version of the server
+std::vector<std::vector<Document>> ProcessQueries(
+    const ConcurrentSearchServer& search_server,
+    const std::vector<std::string>& queries);
+
+std::vector<Document> ProcessQueriesJoined(
+    const ConcurrentSearchServer& search_server,
+    const std::vector<std::string>& queries);
@@ -0,0 +1,21 @@
+#pragma once
+#include "document.h"
+#include "paginator.h"
+#include <vector>
+
+// Documents found for a batch of queries, kept in one flat buffer.
+// Documents of query i are documents[offsets[i]] ... documents[offsets[i + 1] - 1].
+struct QueryBatchResult {
+    std::vector<Document> documents;
+    std::vector<size_t> offsets;
+
+    size_t GetQueryCount() const {
+        return offsets.empty() ? 0 : offsets.size() - 1;
+    }
+
+    IteratorRange<std::vector<Document>::const_iterator> GetDocuments(size_t query_index) const {
+        const auto first = documents.begin() + offsets[query_index];
+        const auto last = documents.begin() + offsets[query_index + 1];
+        return {first, last, static_cast<size_t>(last - first)};
+    }
+};
@@ -0,0 +1,89 @@
+#include "relevance_accumulator.h"
+
+void RelevanceAccumulator::Add(int document_id, double relevance) {
+    Page& page = GetPage(document_id);
+    const uint16_t offset = document_id & (PAGE_SIZE - 1);
+    switch (page.states[offset]) {
+        case SlotState::EMPTY:
+            if (page.touched.empty()) {
+                touched_pages_.push_back(static_cast<size_t>(document_id) >> PAGE_BITS);
+            }
+            page.states[offset] = SlotState::SCORED;
+            page.relevances[offset] = relevance;
+            page.touched.push_back(offset);
+            break;
+        case SlotState::SCORED:
+            page.relevances[offset] += relevance;
+            break;
+        case SlotState::EXCLUDED:
+            break;
+    }
+}
+
+void RelevanceAccumulator::Exclude(int document_id) {
+    const size_t page_index = static_cast<size_t>(document_id) >> PAGE_BITS;
+    if (page_index >= pages_.size() || pages_[page_index] == nullptr) {
+        return;
+    }
+    Page& page = *pages_[page_index];
+    const uint16_t offset = document_id & (PAGE_SIZE - 1);
+    if (page.states[offset] == SlotState::SCORED) {
+        page.states[offset] = SlotState::EXCLUDED;
+    }
+}
+
+size_t RelevanceAccumulator::GetPageCount() const {
+    return pages_.size();
+}
+
+void RelevanceAccumulator::Clear() {
+    for (const size_t page_index : touched_pages_) {
+        Page& page = *pages_[page_index];
+        for (const uint16_t offset : page.touched) {
+            page.states[offset] = SlotState::EMPTY;
+        }
+        page.touched.clear();
+    }
+    touched_pages_.clear();
+}
+
+RelevanceAccumulator::Page& RelevanceAccumulator::GetPage(int document_id) {
+    const size_t page_index = static_cast<size_t>(document_id) >> PAGE_BITS;
+    if (page_index >= pages_.size()) {
+        pages_.resize(page_index + 1);
+    }
+    if (pages_[page_index] == nullptr) {
+        pages_[page_index] = std::make_unique<Page>();
+    }
+    return *pages_[page_index];
+}
+
+namespace {
+struct ThreadScratch {
+    RelevanceAccumulator accumulator;
+    bool in_use = false;
+};
+
+thread_local ThreadScratch thread_scratch;
+}
+
+ScratchAccumulator::ScratchAccumulator() {
+    if (thread_scratch.in_use) {
+        own_accumulator_ = std::make_unique<RelevanceAccumulator>();
+        accumulator_ = own_accumulator_.get();
+    } else {
+        thread_scratch.in_use = true;
+        accumulator_ = &thread_scratch.accumulator;
+    }
+}
+
+ScratchAccumulator::~ScratchAccumulator() {
+    if (own_accumulator_ == nullptr) {
+        accumulator_->Clear();
+        thread_scratch.in_use = false;
+    }
+}
+
+RelevanceAccumulator& ScratchAccumulator::Get() {
+    return *accumulator_;
+}
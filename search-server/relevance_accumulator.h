@@ -0,0 +1,88 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Relevance scores indexed by document id. Scores live in fixed-size pages allocated on first touch,
+// every page remembers its touched slots and the accumulator its touched pages, so Clear() costs
+// only as much as the last query touched.
+class RelevanceAccumulator {
+public:
+    static constexpr int PAGE_BITS = 12;
+    static constexpr int PAGE_SIZE = 1 << PAGE_BITS;
+
+    void Add(int document_id, double relevance);
+
+    // Drops an already scored document from the results, later Add calls for it are ignored
+    void Exclude(int document_id);
+
+    // Calls function(document_id, relevance) for every scored document on pages [first_page, last_page)
+    template <typename Function>
+    void ForEach(size_t first_page, size_t last_page, Function function) const;
+
+    template <typename Function>
+    void ForEach(Function function) const;
+
+    size_t GetPageCount() const;
+
+    void Clear();
+
+private:
+    enum class SlotState : uint8_t {
+        EMPTY,
+        SCORED,
+        EXCLUDED,
+    };
+
+    struct Page {
+        double relevances[PAGE_SIZE];
+        SlotState states[PAGE_SIZE];
+        std::vector<uint16_t> touched;
+    };
+
+    std::vector<std::unique_ptr<Page>> pages_;
+    // Indexes of pages with touched slots
+    std::vector<size_t> touched_pages_;
+
+    Page& GetPage(int document_id);
+};
+
+// Thread-local accumulator leased for the duration of one query.
+// A nested query on the same thread gets a private accumulator instead.
+class ScratchAccumulator {
+public:
+    ScratchAccumulator();
+
+    ScratchAccumulator(const ScratchAccumulator&) = delete;
+
+    ScratchAccumulator& operator=(const ScratchAccumulator&) = delete;
+
+    ~ScratchAccumulator();
+
+    RelevanceAccumulator& Get();
+
+private:
+    RelevanceAccumulator* accumulator_;
+    std::unique_ptr<RelevanceAccumulator> own_accumulator_;
+};
+
+template <typename Function>
+void RelevanceAccumulator::ForEach(size_t first_page, size_t last_page, Function function) const {
+    for (size_t page_index = first_page; page_index < last_page && page_index < pages_.size(); ++page_index) {
+        const Page* page = pages_[page_index].get();
+        if (page == nullptr) {
+            continue;
+        }
+        const int page_begin = static_cast<int>(page_index << PAGE_BITS);
+        for (const uint16_t offset : page->touched) {
+            if (page->states[offset] == SlotState::SCORED) {
+                function(page_begin + offset, page->relevances[offset]);
+            }
+        }
+    }
+}
+
+template <typename Function>
+void RelevanceAccumulator::ForEach(Function function) const {
+    ForEach(0, pages_.size(), function);
+}
@@ -1,23 +1,192 @@
 #include "remove_duplicates.h"
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
 
-void RemoveDuplicates(SearchServer& search_server) {
-std::set<std::set<std::string>> unique_documents;
-std::vector<int> ids_to_remove;
-for (int id : search_server) {
-    std::set<std::string> words;
-    for (const auto& [word, ids] : search_server.GetWordFrequencies(id)) {
-    words.insert(std::string(word));
+namespace {
+
+uint64_t MixHash(uint64_t value) {
+    value ^= value >> 30;
+    value *= 0xbf58476d1ce4e5b9ULL;
+    value ^= value >> 27;
+    value *= 0x94d049bb133111ebULL;
+    value ^= value >> 31;
+    return value;
+}
+
+// Word ids are dictionary ids of one server, equal words of its documents have equal ids
+uint64_t HashWord(int word_id, uint64_t seed) {
+    return MixHash((static_cast<uint64_t>(word_id) + 1) * 0x9e3779b97f4a7c15ULL ^ seed);
+}
+
+// Two independent 64-bit hashes of a set of words, a collision of distinct sets is practically impossible
+struct Signature {
+    uint64_t low;
+    uint64_t high;
+
+    bool operator==(const Signature& other) const {
+        return low == other.low && high == other.high;
+    }
+};
+
+struct SignatureHasher {
+    size_t operator()(const Signature& signature) const {
+        return static_cast<size_t>(signature.low);
+    }
+};
+
+// Word ids come sorted, so equal sets get equal signatures
+Signature ComputeSignature(const std::vector<int>& word_ids) {
+    Signature signature = {word_ids.size(), ~static_cast<uint64_t>(word_ids.size())};
+    for (const int word_id : word_ids) {
+        signature.low = MixHash(signature.low ^ HashWord(word_id, 0));
+        signature.high = MixHash(signature.high + HashWord(word_id, 0x5bd1e9955bd1e995ULL));
+    }
+    return signature;
+}
+
+// The i-th value is the smallest i-th hash of the words, two documents agree on it with probability
+// equal to the Jaccard similarity of their words
+std::vector<uint64_t> ComputeMinHashes(const std::vector<int>& word_ids, size_t count) {
+    std::vector<uint64_t> min_hashes(count, UINT64_MAX);
+    for (const int word_id : word_ids) {
+        const uint64_t hash = HashWord(word_id, 0);
+        for (size_t i = 0; i < count; ++i) {
+            min_hashes[i] = std::min(min_hashes[i], MixHash(hash + (i + 1) * 0x9e3779b97f4a7c15ULL));
+        }
+    }
+    return min_hashes;
+}
+
+double ComputeJaccardSimilarity(const std::vector<int>& lhs, const std::vector<int>& rhs) {
+    if (lhs.empty() && rhs.empty()) {
+        return 1.0;
     }
-    if (unique_documents.count(words)) {
-        ids_to_remove.push_back(id);
-    } else {
-        unique_documents.insert(words);
+    size_t common = 0;
+    for (auto left = lhs.begin(), right = rhs.begin(); left != lhs.end() && right != rhs.end();) {
+        if (*left < *right) {
+            ++left;
+        } else if (*right < *left) {
+            ++right;
+        } else {
+            ++common;
+            ++left;
+            ++right;
+        }
     }
+    return static_cast<double>(common) / static_cast<double>(lhs.size() + rhs.size() - common);
 }
-if (!ids_to_remove.empty()) {
-    for (int id: ids_to_remove) {
+
+// Fewer rows per band let more pairs through to the exact check. The most rows are taken for which
+// documents exactly at the threshold still share a band with probability 0.95: 1 - (1 - s^r)^b.
+size_t ChooseBandRowCount(size_t minhash_count, double min_similarity) {
+    size_t best_rows = 1;
+    for (size_t rows = 1; rows <= minhash_count; ++rows) {
+        const double bands = static_cast<double>(minhash_count / rows);
+        if (1.0 - std::pow(1.0 - std::pow(min_similarity, static_cast<double>(rows)), bands) >= 0.95) {
+            best_rows = rows;
+        }
+    }
+    return best_rows;
+}
+
+// Words of every document are read and hashed in parallel, only the signatures are kept
+std::vector<int> FindExactDuplicates(const SearchServer& search_server, const std::vector<int>& ids) {
+    std::vector<Signature> signatures(ids.size());
+    std::transform(std::execution::par,
+                   ids.begin(),
+                   ids.end(),
+                   signatures.begin(),
+                   [&search_server](int id) {
+                       return ComputeSignature(search_server.GetDocumentWordIds(id));
+                   });
+    std::vector<int> duplicates;
+    std::unordered_set<Signature, SignatureHasher> unique_signatures;
+    unique_signatures.reserve(ids.size());
+    for (size_t i = 0; i < ids.size(); ++i) {
+        if (!unique_signatures.insert(signatures[i]).second) {
+            duplicates.push_back(ids[i]);
+        }
+    }
+    return duplicates;
+}
+
+// Only the MinHashes are kept, words are read again for the exact check of candidates
+std::vector<int> FindNearDuplicates(const SearchServer& search_server, const std::vector<int>& ids,
+                                    const DuplicateOptions& options) {
+    const size_t minhash_count = std::max<size_t>(options.minhash_count, 1);
+    std::vector<std::vector<uint64_t>> min_hashes(ids.size());
+    std::transform(std::execution::par,
+                   ids.begin(),
+                   ids.end(),
+                   min_hashes.begin(),
+                   [&search_server, minhash_count](int id) {
+                       return ComputeMinHashes(search_server.GetDocumentWordIds(id), minhash_count);
+                   });
+
+    // Documents sharing all the values of some band are candidates, only kept documents go to the buckets
+    const size_t row_count = ChooseBandRowCount(minhash_count, options.min_similarity);
+    const size_t band_count = minhash_count / row_count;
+    std::vector<std::unordered_map<uint64_t, std::vector<size_t>>> buckets(band_count);
+    std::vector<size_t> checked_by(ids.size(), ids.size());
+    std::vector<uint64_t> band_keys(band_count);
+    std::vector<int> duplicates;
+    for (size_t i = 0; i < ids.size(); ++i) {
+        std::vector<int> word_ids;
+        bool has_word_ids = false;
+        bool is_duplicate = false;
+        for (size_t band = 0; band < band_count && !is_duplicate; ++band) {
+            uint64_t key = band;
+            for (size_t row = band * row_count; row < (band + 1) * row_count; ++row) {
+                key = MixHash(key ^ min_hashes[i][row]);
+            }
+            band_keys[band] = key;
+            const auto it = buckets[band].find(key);
+            if (it == buckets[band].end()) {
+                continue;
+            }
+            for (const size_t candidate : it->second) {
+                if (checked_by[candidate] == i) {
+                    continue;
+                }
+                checked_by[candidate] = i;
+                if (!has_word_ids) {
+                    word_ids = search_server.GetDocumentWordIds(ids[i]);
+                    has_word_ids = true;
+                }
+                if (ComputeJaccardSimilarity(word_ids, search_server.GetDocumentWordIds(ids[candidate]))
+                    >= options.min_similarity) {
+                    is_duplicate = true;
+                    break;
+                }
+            }
+        }
+        if (is_duplicate) {
+            duplicates.push_back(ids[i]);
+            continue;
+        }
+        for (size_t band = 0; band < band_count; ++band) {
+            buckets[band][band_keys[band]].push_back(i);
+        }
+    }
+    return duplicates;
+}
+
+}  // namespace
+
+std::vector<int> FindDuplicates(const SearchServer& search_server, const DuplicateOptions& options) {
+    const std::vector<int> ids(search_server.begin(), search_server.end());
+    if (options.min_similarity >= 1.0) {
+        return FindExactDuplicates(search_server, ids);
+    }
+    return FindNearDuplicates(search_server, ids, options);
+}
+
+void RemoveDuplicates(SearchServer& search_server, const DuplicateOptions& options) {
+    const std::vector<int> ids_to_remove = FindDuplicates(search_server, options);
+    for (const int id : ids_to_remove) {
         std::cout << "Found duplicate document id " << id << std::endl;
-        search_server.RemoveDocument(id);
     }
+    search_server.RemoveDocuments(ids_to_remove);
 }
-}
\ No newline at end of file
@@ -1,4 +1,15 @@
 #pragma once
 #include "search_server.h"
 
-void RemoveDuplicates(SearchServer& search_server);
\ No newline at end of file
+struct DuplicateOptions {
+    // Documents are duplicates when the Jaccard similarity of their sets of words reaches min_similarity.
+    // 1 asks for exactly the same sets, lower values also find near duplicates with MinHash and LSH banding.
+    double min_similarity = 1.0;
+    // Length of MinHash signatures, longer ones miss fewer near duplicates and take longer to build
+    size_t minhash_count = 128;
+};
+
+// Ids of documents that duplicate a document with a smaller id, in ascending order
+std::vector<int> FindDuplicates(const SearchServer& search_server, const DuplicateOptions& options = {});
+
+void RemoveDuplicates(SearchServer& search_server, const DuplicateOptions& options = {});
@@ -1,14 +1,37 @@
 #include "request_queue.h"
 
-RequestQueue::RequestQueue(const SearchServer& search_server) : server_(search_server) {
+RequestQueue::RequestQueue(const SearchServer& search_server, size_t worker_count)
+        : server_(search_server)
+        , workers_(worker_count) {
 }
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentStatus status) {
-    auto lambda = [status](int document_id, DocumentStatus status_lambda, int rating) { return status_lambda == status ;};
-    return  AddFindRequest(raw_query, lambda);
+    return AddFindRequest<DocumentStatus>(raw_query, status);
 }
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query) {
     return AddFindRequest(raw_query, DocumentStatus::ACTUAL);
 }
+std::future<std::vector<Document>> RequestQueue::AddFindRequestAsync(std::string raw_query, DocumentStatus status) {
+    return AddFindRequestAsync<DocumentStatus>(std::move(raw_query), status);
+}
+std::future<std::vector<Document>> RequestQueue::AddFindRequestAsync(std::string raw_query) {
+    return AddFindRequestAsync(std::move(raw_query), DocumentStatus::ACTUAL);
+}
 int RequestQueue::GetNoResultRequests() const {
-    return empty_req_count_;
-}
\ No newline at end of file
+    return empty_req_count_.load(std::memory_order_relaxed);
+}
+void RequestQueue::AddResult(bool is_empty) {
+    const uint64_t request = request_count_.fetch_add(1, std::memory_order_relaxed);
+    const uint64_t stamp = ((request + 1) << 1) | (is_empty ? 1 : 0);
+    std::atomic<uint64_t>& slot = window_[request % min_in_day_];
+    uint64_t old_stamp = slot.load(std::memory_order_relaxed);
+    do {
+        if (old_stamp > stamp) {
+            // A newer request of this slot has finished already, this one is out of the window
+            return;
+        }
+    } while (!slot.compare_exchange_weak(old_stamp, stamp, std::memory_order_relaxed));
+    const int delta = (is_empty ? 1 : 0) - static_cast<int>(old_stamp & 1);
+    if (delta != 0) {
+        empty_req_count_.fetch_add(delta, std::memory_order_relaxed);
+    }
+}
@@ -1,59 +1,53 @@
 #pragma once
 #include "search_server.h"
-#include <stack>
+#include "worker_pool.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <future>
+
+// Searches of the server together with the number of requests that found nothing among the last min_in_day_.
+// Requests may come from several threads at once, asynchronous ones are answered by a pool of workers.
+// The server must not change while requests are answered.
 class RequestQueue {
 public:
-    explicit RequestQueue(const SearchServer& search_server);
+    // worker_count threads answer asynchronous requests, 0 takes the number of hardware threads
+    explicit RequestQueue(const SearchServer& search_server, size_t worker_count = 0);
     template <typename DocumentPredicate>
     std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate);
     std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentStatus status);
     std::vector<Document> AddFindRequest(const std::string& raw_query);
+    // Requests join the window in the order their results come
+    template <typename DocumentPredicate>
+    std::future<std::vector<Document>> AddFindRequestAsync(std::string raw_query, DocumentPredicate document_predicate);
+    std::future<std::vector<Document>> AddFindRequestAsync(std::string raw_query, DocumentStatus status);
+    std::future<std::vector<Document>> AddFindRequestAsync(std::string raw_query);
     int GetNoResultRequests() const;
 private:
-    struct QueryResult {
-        bool empty_req;
-        std::string request;
-        int result_count;
-    };
-    std::deque<QueryResult> requests_;
     const static int min_in_day_ = 1440;
     const SearchServer& server_;
-    int time = 0;
-    int empty_req_count_= 0;
+    // Ring of the last results: the slot of request n holds ((n + 1) << 1) | (1 if nothing was found),
+    // 0 if it was never written. A result takes its slot only from an older one, so a request finishing late
+    // cannot push out a newer one. empty_req_count_ is the number of slots marking empty results.
+    std::array<std::atomic<uint64_t>, min_in_day_> window_{};
+    std::atomic<uint64_t> request_count_ = 0;
+    std::atomic<int> empty_req_count_ = 0;
+    // Declared last, so the workers are joined before the window goes away
+    WorkerPool workers_;
+
+    void AddResult(bool is_empty);
 };
 
 template <typename DocumentPredicate>
 std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate) {
-    ++time;
     std::vector<Document> result = server_.FindTopDocuments(raw_query, document_predicate);
-    if (time<=min_in_day_) {
-        if (result.empty()) {
-            requests_.push_back({true, raw_query, static_cast<int>(result.size())});
-            ++empty_req_count_;
-            return result;
-        } else {
-            requests_.push_back({false, raw_query, static_cast<int>(result.size())});
-            return result;
-        }
+    AddResult(result.empty());
+    return result;
+}
 
-    }
-    else {
-        if (result.empty()) {
-            if (!requests_.front().empty_req) {
-                ++empty_req_count_;
-            }
-            requests_.pop_front();
-            requests_.push_back({true, raw_query, static_cast<int>(result.size())});
-            return result;
-
-        } else {
-            if (requests_.front().empty_req) {
-                --empty_req_count_;
-            }
-            requests_.pop_front();
-            requests_.push_back({false, raw_query, static_cast<int>(result.size())});
-            return result;
-        }
-    }
-    // напишите реализацию
-}
\ No newline at end of file
+template <typename DocumentPredicate>
+std::future<std::vector<Document>> RequestQueue::AddFindRequestAsync(std::string raw_query, DocumentPredicate document_predicate) {
+    return workers_.Submit([this, raw_query = std::move(raw_query), document_predicate]() {
+        return AddFindRequest(raw_query, document_predicate);
+    });
+}
@@ -0,0 +1,90 @@
+#include "result_cache.h"
+#include <algorithm>
+#include <functional>
+
+ResultCache::ResultCache(size_t max_bytes, size_t shard_count)
+        : max_shard_bytes_(max_bytes / std::max<size_t>(shard_count, 1)),
+          shards_(std::max<size_t>(shard_count, 1)) {
+}
+
+uint64_t ResultCache::GetGeneration() const {
+    return generation_.load(std::memory_order_acquire);
+}
+
+uint64_t ResultCache::Invalidate() {
+    return generation_.fetch_add(1, std::memory_order_acq_rel) + 1;
+}
+
+std::optional<std::vector<Document>> ResultCache::Find(const std::string& key, uint64_t generation) {
+    Shard& shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    const auto it = shard.index.find(key);
+    if (it == shard.index.end()) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+    if (it->second->generation != generation) {
+        // An entry of a newer generation is kept for the readers of that generation
+        if (it->second->generation < generation) {
+            shard.Erase(it->second);
+        }
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return std::nullopt;
+    }
+    shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return shard.entries.front().documents;
+}
+
+void ResultCache::Insert(const std::string& key, const std::vector<Document>& documents, uint64_t generation) {
+    const size_t bytes = ComputeEntryBytes(key, documents);
+    if (bytes > max_shard_bytes_) {
+        return;
+    }
+    Shard& shard = GetShard(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    // Checked under the lock, so an entry of a finished generation cannot slip in after a writer moved on
+    if (generation != GetGeneration()) {
+        return;
+    }
+    const auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+        shard.Erase(it->second);
+    }
+    shard.entries.push_front({key, documents, generation, bytes});
+    shard.index.emplace(shard.entries.front().key, shard.entries.begin());
+    shard.used_bytes += bytes;
+    while (shard.used_bytes > max_shard_bytes_) {
+        shard.Erase(std::prev(shard.entries.end()));
+        evictions_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+ResultCacheStats ResultCache::GetStats() const {
+    ResultCacheStats stats;
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    stats.evictions = evictions_.load(std::memory_order_relaxed);
+    for (const Shard& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        stats.entry_count += shard.entries.size();
+        stats.used_bytes += shard.used_bytes;
+    }
+    return stats;
+}
+
+void ResultCache::Shard::Erase(std::list<Entry>::iterator it) {
+    used_bytes -= it->bytes;
+    index.erase(it->key);
+    entries.erase(it);
+}
+
+ResultCache::Shard& ResultCache::GetShard(const std::string& key) {
+    return shards_[std::hash<std::string>{}(key) % shards_.size()];
+}
+
+size_t ResultCache::ComputeEntryBytes(const std::string& key, const std::vector<Document>& documents) {
+    const size_t list_node_bytes = sizeof(Entry) + 2 * sizeof(void*);
+    const size_t index_node_bytes = sizeof(std::string_view) + 3 * sizeof(void*);
+    return list_node_bytes + index_node_bytes + key.size() + documents.size() * sizeof(Document);
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include "document.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+struct ResultCacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    // Entries pushed out to stay within the memory limit
+    uint64_t evictions = 0;
+    size_t entry_count = 0;
+    size_t used_bytes = 0;
+};
+
+// Results of recent queries, split into independently locked shards. Every shard keeps its entries
+// in least recently used order within an equal share of the memory limit.
+// Entries remember the generation of the index they were computed on. Invalidate starts a new generation,
+// which makes all older entries stale at once, they are dropped when met again. Readers of an older version
+// of the index may still look up their own generation, but cannot store results any more.
+class ResultCache {
+public:
+    static constexpr size_t DEFAULT_SHARD_COUNT = 16;
+
+    explicit ResultCache(size_t max_bytes, size_t shard_count = DEFAULT_SHARD_COUNT);
+
+    uint64_t GetGeneration() const;
+
+    // Returns the new generation
+    uint64_t Invalidate();
+
+    // Documents cached for the key in the given generation
+    std::optional<std::vector<Document>> Find(const std::string& key, uint64_t generation);
+
+    // Ignored if the generation is over, as the documents may already be outdated
+    void Insert(const std::string& key, const std::vector<Document>& documents, uint64_t generation);
+
+    ResultCacheStats GetStats() const;
+
+private:
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+
+    struct Entry {
+        std::string key;
+        std::vector<Document> documents;
+        uint64_t generation;
+        size_t bytes;
+    };
+
+    struct alignas(CACHE_LINE_SIZE) Shard {
+        mutable std::mutex mutex;
+        // Most recently used entries go first, index keys are views into the entries
+        std::list<Entry> entries;
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index;
+        size_t used_bytes = 0;
+
+        void Erase(std::list<Entry>::iterator it);
+    };
+
+    size_t max_shard_bytes_;
+    std::vector<Shard> shards_;
+    std::atomic<uint64_t> generation_ = 0;
+    std::atomic<uint64_t> hits_ = 0;
+    std::atomic<uint64_t> misses_ = 0;
+    std::atomic<uint64_t> evictions_ = 0;
+
+    Shard& GetShard(const std::string& key);
+
+    // Approximate memory taken by an entry together with its list node and index slot
+    static size_t ComputeEntryBytes(const std::string& key, const std::vector<Document>& documents);
+};
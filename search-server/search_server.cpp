@@ -4,6 +4,9 @@
 #include <algorithm>
 #include <cmath>
 #include <numeric>
+#include <queue>
+#include <execution>
+#include <atomic>
 
 SearchServer::SearchServer(const std::string& stopwords)
         : SearchServer(std::string_view(stopwords)) {
@@ -13,12 +16,24 @@ SearchServer::SearchServer (const std::string_view& stopwords)
         : SearchServer(SplitIntoWords(stopwords))   {
 }
 
-std::set<int>::const_iterator SearchServer::begin() const {
-    return documents_ids_.begin();
+SearchServer::~SearchServer() {
+    // A deferred merge has not started and is dropped, a moved-from server has no merge left
+    if (pending_merge_ && pending_merge_->result.valid()
+        && pending_merge_->result.wait_for(std::chrono::seconds(0)) != std::future_status::deferred) {
+        pending_merge_->result.wait();
+    }
+}
+
+SearchServer SearchServer::Fork() const {
+    return SearchServer(*this);
+}
+
+SearchServer::DocumentIdIterator SearchServer::begin() const {
+    return documents_.BeginIds();
 }
 
-std::set<int>::const_iterator SearchServer::end() const {
-    return documents_ids_.end();
+SearchServer::DocumentIdIterator SearchServer::end() const {
+    return documents_.EndIds();
 }
 
 void SearchServer::AddDocument(int document_id, const std::string_view& document, DocumentStatus status,
@@ -30,116 +45,559 @@ void SearchServer::AddDocument(int document_id, const std::string_view& document
         throw std::invalid_argument("ID is already in server " + std::to_string(document_id));
     }
 
-    documents_.emplace(document_id, DocumentData{ComputeAverageRating(ratings), status, std::string(document)});
-    const std::vector<std::string_view> words = SplitIntoWordsNoStop(documents_[document_id].words);
-    const double inv_word_count = 1.0 / static_cast<double>(words.size());
-    documents_ids_.insert(document_id);
+    // Words are checked before anything is stored, an invalid document leaves the server unchanged
+    const std::vector<std::string_view> words = SplitIntoWordsNoStop(document);
+    const int document_length = static_cast<int>(words.size());
+    documents_.Insert(document_id, DocumentData{ComputeAverageRating(ratings), status, document_texts_->Store(document)});
+    status_documents_[static_cast<size_t>(status)].Insert(document_id);
+    mutable_segment_.AddDocument(document_id, document_length);
 
+    // Occurrences are counted as runs of equal ids
+    std::vector<int> word_ids;
+    word_ids.reserve(words.size());
     for (const std::string_view word: words) {
-        word_to_document_freqs_[word][document_id] += inv_word_count;
-        words_freq_[document_id][word] +=inv_word_count;
+        word_ids.push_back(GetOrAddWordId(word));
     }
+    if (position_index_) {
+        position_index_->Add(document_id, word_ids);
+    }
+    std::sort(word_ids.begin(), word_ids.end());
+    std::vector<ForwardEntry> entries;
+    for (auto it = word_ids.begin(); it != word_ids.end();) {
+        const auto run_end = std::upper_bound(it, word_ids.end(), *it);
+        entries.push_back({*it, static_cast<int>(run_end - it)});
+        InsertPosting(*it, {document_id, entries.back().occurrences, document_length});
+        it = run_end;
+    }
+    forward_index_.Add(document_id, document_length, entries);
+    SealIfFull();
+    InvalidateResults();
+}
 
+void SearchServer::AddDocuments(const std::vector<NewDocument>& documents) {
+    // Texts are tokenized where the caller keeps them, they are copied only once the whole batch is accepted
+    std::map<int, const NewDocument*> batch_documents;
+    for (const NewDocument& document : documents) {
+        if (document.id < 0) {
+            throw std::invalid_argument("Incorrect ID " + std::to_string(document.id));
+        }
+        if (documents_.count(document.id) || !batch_documents.emplace(document.id, &document).second) {
+            throw std::invalid_argument("ID is already in server " + std::to_string(document.id));
+        }
+    }
+
+    std::vector<std::pair<int, std::string_view>> texts;
+    texts.reserve(batch_documents.size());
+    for (const auto& [document_id, document] : batch_documents) {
+        texts.emplace_back(document_id, document->text);
+    }
+    std::vector<std::map<std::string_view, int>> word_counts(texts.size());
+    // Words in text order are kept only for the positional index
+    std::vector<std::vector<std::string_view>> document_words(position_index_ ? texts.size() : 0);
+    std::vector<int> document_lengths(texts.size(), 0);
+    std::vector<char> is_invalid(texts.size(), false);
+    std::vector<size_t> indexes(texts.size());
+    std::iota(indexes.begin(), indexes.end(), 0);
+    std::for_each(std::execution::par,
+                  indexes.begin(),
+                  indexes.end(),
+                  [&](size_t i) {
+                      try {
+                          std::vector<std::string_view> words = SplitIntoWordsNoStop(texts[i].second);
+                          document_lengths[i] = static_cast<int>(words.size());
+                          for (const std::string_view word : words) {
+                              ++word_counts[i][word];
+                          }
+                          if (position_index_) {
+                              document_words[i] = std::move(words);
+                          }
+                      } catch (const std::invalid_argument&) {
+                          is_invalid[i] = true;
+                      }
+                  });
+    if (std::find(is_invalid.begin(), is_invalid.end(), true) != is_invalid.end()) {
+        throw std::invalid_argument( "Incorrect symbol in document text : ");
+    }
+
+    // Every chunk is a run of ids in ascending order, so its partial posting lists come out sorted
+    const size_t chunk_count = std::max<size_t>(1, std::min<size_t>(texts.size(), std::max(1u, std::thread::hardware_concurrency()) * 4));
+    const size_t chunk_size = (texts.size() + chunk_count - 1) / chunk_count;
+    std::vector<std::unordered_map<std::string_view, std::vector<PostingEntry>>> partial_postings(chunk_count);
+    std::vector<size_t> chunk_indexes(chunk_count);
+    std::iota(chunk_indexes.begin(), chunk_indexes.end(), 0);
+    std::for_each(std::execution::par,
+                  chunk_indexes.begin(),
+                  chunk_indexes.end(),
+                  [&](size_t chunk) {
+                      const size_t last = std::min(texts.size(), (chunk + 1) * chunk_size);
+                      for (size_t i = chunk * chunk_size; i < last; ++i) {
+                          for (const auto [word, occurrences] : word_counts[i]) {
+                              partial_postings[chunk][word].push_back({texts[i].first, occurrences, document_lengths[i]});
+                          }
+                      }
+                  });
+
+    // Dictionary ids are handed out sequentially, then the parts of every word are joined by its own task.
+    // Parts come in chunk order, so joined together they are still sorted by id.
+    std::unordered_map<int, size_t> word_id_to_slot;
+    std::vector<std::vector<const std::vector<PostingEntry>*>> word_parts;
+    std::vector<std::pair<int, std::vector<PostingEntry>>> word_entries;
+    for (const auto& chunk_postings : partial_postings) {
+        for (const auto& [word, postings] : chunk_postings) {
+            const int word_id = GetOrAddWordId(word);
+            const auto [it, inserted] = word_id_to_slot.emplace(word_id, word_entries.size());
+            if (inserted) {
+                word_entries.emplace_back(word_id, std::vector<PostingEntry>{});
+                word_parts.emplace_back();
+            }
+            word_parts[it->second].push_back(&postings);
+            AddDocumentFreq(word_id, static_cast<int>(postings.size()));
+        }
+    }
+    std::vector<size_t> word_indexes(word_entries.size());
+    std::iota(word_indexes.begin(), word_indexes.end(), 0);
+    std::for_each(std::execution::par,
+                  word_indexes.begin(),
+                  word_indexes.end(),
+                  [&](size_t i) {
+                      std::vector<PostingEntry>& entries = word_entries[i].second;
+                      for (const std::vector<PostingEntry>* part : word_parts[i]) {
+                          entries.insert(entries.end(), part->begin(), part->end());
+                      }
+                  });
+    mutable_segment_.AddPostings(word_entries);
+
+    // Words of every document are turned to ids, the caller's texts may go away after the call
+    std::vector<std::vector<ForwardEntry>> forward_entries(texts.size());
+    std::vector<std::vector<int>> position_word_ids(document_words.size());
+    std::for_each(std::execution::par,
+                  indexes.begin(),
+                  indexes.end(),
+                  [&](size_t i) {
+                      if (position_index_) {
+                          position_word_ids[i].reserve(document_words[i].size());
+                          for (const std::string_view word : document_words[i]) {
+                              position_word_ids[i].push_back(FindWordId(word));
+                          }
+                      }
+                      forward_entries[i].reserve(word_counts[i].size());
+                      for (const auto [word, occurrences] : word_counts[i]) {
+                          forward_entries[i].push_back({FindWordId(word), occurrences});
+                      }
+                      std::sort(forward_entries[i].begin(), forward_entries[i].end(),
+                                [](const ForwardEntry& lhs, const ForwardEntry& rhs) {
+                                    return lhs.word_id < rhs.word_id;
+                                });
+                  });
+
+    for (size_t i = 0; i < texts.size(); ++i) {
+        const NewDocument& document = *batch_documents.at(texts[i].first);
+        documents_.Insert(document.id, DocumentData{ComputeAverageRating(document.ratings), document.status,
+                                                    document_texts_->Store(document.text)});
+        status_documents_[static_cast<size_t>(document.status)].Insert(document.id);
+        forward_index_.Add(document.id, document_lengths[i], forward_entries[i]);
+        if (position_index_) {
+            position_index_->Add(document.id, position_word_ids[i]);
+        }
+        mutable_segment_.AddDocument(document.id, document_lengths[i]);
+    }
+    SealIfFull();
+    InvalidateResults();
 }
 
-std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw_query, DocumentStatus status) const {
-    auto lambda = [status](int document_id, DocumentStatus status_lambda, int rating) {
-        return status_lambda == status ;
-    };
-    return  FindTopDocuments(raw_query, lambda);
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw_query, DocumentStatus status,
+                                                     size_t max_count) const {
+    return FindTopDocuments(std::execution::seq, raw_query, status, max_count);
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw_query) const {
     return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
 }
 
+QueryBatchResult SearchServer::FindTopDocumentsBatch(const std::vector<std::string>& raw_queries, size_t max_count) const {
+    const QueryMetrics& metrics = GetQueryMetrics();
+    GetMetrics().Add(metrics.queries, raw_queries.size());
+    std::unordered_map<std::string_view, int> batch_word_ids;
+    auto resolve_word = [&](std::string_view word) {
+        const auto [it, inserted] = batch_word_ids.emplace(word, NO_WORD_ID);
+        if (inserted) {
+            it->second = FindWordId(word);
+        }
+        return it->second;
+    };
+    auto posting_count = [this](int word_id) {
+        return static_cast<size_t>(GetDocumentFreq(word_id));
+    };
+
+    // Equal query strings, and strings parsing to the same words, share one query.
+    // Every distinct string is timed as one parse, resolving the words of a new query included.
+    std::unordered_map<std::string_view, size_t> text_to_query;
+    std::unordered_map<std::string, size_t> words_to_query;
+    std::vector<Query> queries;
+    // A query costs about as much as the postings it walks
+    std::vector<size_t> costs;
+    std::vector<size_t> query_indexes(raw_queries.size());
+    for (size_t i = 0; i < raw_queries.size(); ++i) {
+        const auto [text_it, text_inserted] = text_to_query.emplace(raw_queries[i], queries.size());
+        if (text_inserted) {
+            ScopedTimer timer(metrics.parse);
+            Query query = ParseQueryWords(raw_queries[i]);
+            const auto [words_it, words_inserted] =
+                    words_to_query.emplace(MakeResultCacheKey(query, DocumentStatus::ACTUAL, max_count), queries.size());
+            if (words_inserted) {
+                size_t cost = 1;
+                for (const std::string_view& word : query.plus_words) {
+                    query.plus_word_ids.push_back(resolve_word(word));
+                    cost += posting_count(query.plus_word_ids.back());
+                }
+                for (const std::string_view& word : query.minus_words) {
+                    query.minus_word_ids.push_back(resolve_word(word));
+                    cost += posting_count(query.minus_word_ids.back());
+                }
+                ExpandPrefixes(query);
+                for (const std::vector<int>& word_ids : query.plus_prefix_word_ids) {
+                    for (const int word_id : word_ids) {
+                        cost += posting_count(word_id);
+                    }
+                }
+                ResolvePhrases(query);
+                queries.push_back(std::move(query));
+                costs.push_back(cost);
+            }
+            text_it->second = words_it->second;
+        }
+        query_indexes[i] = text_it->second;
+    }
+
+    // Longest processing time first: the next most expensive query goes to the least loaded worker
+    const size_t worker_count = std::min<size_t>(queries.size(), std::max(1u, std::thread::hardware_concurrency()));
+    std::vector<size_t> order(queries.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&costs](size_t lhs, size_t rhs) {
+        return costs[lhs] > costs[rhs];
+    });
+    std::vector<std::vector<size_t>> worker_queries(worker_count);
+    std::priority_queue<std::pair<size_t, size_t>, std::vector<std::pair<size_t, size_t>>, std::greater<>> worker_loads;
+    for (size_t worker = 0; worker < worker_count; ++worker) {
+        worker_loads.push({0, worker});
+    }
+    for (const size_t query_index : order) {
+        const auto [load, worker] = worker_loads.top();
+        worker_loads.pop();
+        worker_queries[worker].push_back(query_index);
+        worker_loads.push({load + costs[query_index], worker});
+    }
+
+    std::vector<std::vector<Document>> answers(queries.size());
+    std::for_each(std::execution::par,
+                  worker_queries.begin(),
+                  worker_queries.end(),
+                  [&](const std::vector<size_t>& assigned) {
+                      for (const size_t query_index : assigned) {
+                          answers[query_index] = FindAllDocuments(std::execution::seq, queries[query_index], DocumentStatus::ACTUAL, max_count);
+                      }
+                  });
+
+    QueryBatchResult result;
+    result.offsets.reserve(raw_queries.size() + 1);
+    result.offsets.push_back(0);
+    for (const size_t query_index : query_indexes) {
+        result.documents.insert(result.documents.end(), answers[query_index].begin(), answers[query_index].end());
+        result.offsets.push_back(result.documents.size());
+    }
+    return result;
+}
+
 size_t SearchServer::GetDocumentCount() const {
     return documents_.size();
 }
 
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::string_view& raw_query, int document_id) const {
-    if ((document_id < 0) || !(documents_.count(document_id))) {
-        throw std::invalid_argument("Invalid document ID"s);
+void SearchServer::SetQueryEvaluation(QueryEvaluation evaluation) {
+    query_evaluation_ = evaluation;
+}
+
+void SearchServer::SetPositionalIndex(bool enabled) {
+    if (!enabled) {
+        position_index_.reset();
+        return;
+    }
+    if (position_index_) {
+        return;
+    }
+    position_index_.emplace();
+    for (const auto& [document_id, data] : documents_) {
+        std::vector<int> word_ids;
+        for (const std::string_view word : SplitIntoWordsNoStop(data.words)) {
+            word_ids.push_back(FindWordId(word));
+        }
+        position_index_->Add(document_id, word_ids);
     }
+}
 
-    const Query query = ParseQuery(raw_query);
-    std::vector<std::string_view> matched_words;
-    for (const std::string_view& word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
+void SearchServer::SetResultCacheSize(size_t max_bytes) {
+    result_cache_ = max_bytes > 0 ? std::make_shared<ResultCache>(max_bytes) : nullptr;
+    result_generation_ = 0;
+}
+
+ResultCacheStats SearchServer::GetResultCacheStats() const {
+    return result_cache_ ? result_cache_->GetStats() : ResultCacheStats{};
+}
+
+void SearchServer::SetSegmentOptions(const SegmentOptions& options) {
+    segment_options_ = options;
+    segment_options_.max_mutable_postings = std::max<size_t>(segment_options_.max_mutable_postings, 1);
+    segment_options_.merge_factor = std::max<size_t>(segment_options_.merge_factor, 2);
+    SealIfFull();
+}
+
+MemoryStats SearchServer::GetMemoryStats() const {
+    MemoryStats stats;
+    stats.dictionary_bytes = terms_.GetMemoryBytes() + document_freqs_.GetMemoryBytes();
+    for (const SegmentView& segment : GetSegmentViews()) {
+        stats.posting_bytes += segment.segment->GetMemoryBytes();
+        if (segment.removed != nullptr) {
+            stats.posting_bytes += EstimateHashBytes(*segment.removed);
         }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            matched_words.clear();
-            return std::tuple {matched_words, documents_.at(document_id).status};
+    }
+    stats.forward_index_bytes = forward_index_.GetMemoryBytes() + (position_index_ ? position_index_->GetMemoryBytes() : 0);
+    stats.document_text_bytes = document_texts_->GetCapacity();
+    stats.document_metadata_bytes = documents_.GetMemoryBytes();
+    for (const DocumentBitmap& documents : status_documents_) {
+        stats.document_metadata_bytes += documents.GetMemoryBytes();
+    }
+    stats.mapped_bytes = snapshot_ ? snapshot_->GetFileSize() : 0;
+    stats.term_count = document_freqs_.size();
+    stats.dead_term_count = dead_term_count_;
+    return stats;
+}
+
+void SearchServer::Compact() {
+    if (pending_merge_) {
+        InstallMerge();
+    }
+
+    // Words of the snapshot keep their ids, they are read from the mapped file
+    const int first_id = snapshot_ ? static_cast<int>(snapshot_->GetWordCount()) : 0;
+    TermPool terms(first_id);
+    std::vector<int> new_word_ids(document_freqs_.size(), NO_WORD_ID);
+    SharedVector<int> document_freqs;
+    for (int word_id = 0; word_id < first_id; ++word_id) {
+        new_word_ids[word_id] = word_id;
+        document_freqs.push_back(document_freqs_[word_id]);
+    }
+    for (int word_id = first_id; word_id < static_cast<int>(document_freqs_.size()); ++word_id) {
+        if (document_freqs_[word_id] > 0) {
+            new_word_ids[word_id] = terms.Add(GetWord(word_id));
+            document_freqs.push_back(document_freqs_[word_id]);
         }
     }
 
-    for (const std::string_view& word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
-            continue;
+    std::vector<SealedSegment> sealed_segments;
+    for (const SealedSegment& sealed : sealed_segments_) {
+        IndexSegment segment = IndexSegment::Compact(*sealed.segment, sealed.removed.get(), new_word_ids);
+        if (segment.GetDocumentCount() > 0) {
+            sealed_segments.push_back({std::make_shared<const IndexSegment>(std::move(segment)), nullptr});
         }
-        if (word_to_document_freqs_.at(word).count(document_id)) {
-            matched_words.push_back(word);
+    }
+    mutable_segment_ = IndexSegment::Compact(mutable_segment_, nullptr, new_word_ids);
+    sealed_segments_ = std::move(sealed_segments);
+
+    // New ids keep the order of words, so runs of the forward index stay sorted
+    forward_index_.RenumberWords(new_word_ids);
+    if (position_index_) {
+        position_index_->RenumberWords(new_word_ids);
+    }
+    auto document_texts = std::make_shared<TextArena>();
+    documents_.ForEachMutable([&](int document_id, DocumentData& data) {
+        // Documents of the snapshot are not in the forward index, their texts stay in the mapped file
+        if (forward_index_.Contains(document_id)) {
+            data.words = document_texts->Store(data.words);
         }
+    });
+    terms.Seal();
+    terms_ = std::move(terms);
+    document_texts_ = std::move(document_texts);
+    document_freqs_ = std::move(document_freqs);
+    dead_term_count_ = 0;
+    for (size_t word_id = 0; word_id < document_freqs_.size(); ++word_id) {
+        dead_term_count_ += document_freqs_[word_id] == 0 ? 1 : 0;
     }
+    kept_dead_term_count_ = dead_term_count_;
+    RunMerges(false);
+}
 
-    return std::tuple {matched_words, documents_.at(document_id).status};
+void SearchServer::SetAutoCompaction(double max_dead_term_share) {
+    max_dead_term_share_ = max_dead_term_share;
+    CompactIfChurned();
 }
 
-std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::parallel_policy, const std::string_view& raw_query, int document_id) const {
+void SearchServer::WaitForMerges() {
+    RunMerges(true);
+}
+
+size_t SearchServer::GetSegmentCount() const {
+    return sealed_segments_.size() + 1;
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(const std::string_view& raw_query, int document_id) const {
     if ((document_id < 0) || !(documents_.count(document_id))) {
         throw std::invalid_argument("Invalid document ID"s);
     }
 
-    const Query query = ParseQuery(raw_query, true);
-    std::vector<std::string_view> matched_words(query.plus_words.size());
-    auto lambdaCheck = [&](const std::string_view& word) {
-        return word_to_document_freqs_.at(word).count(document_id);
-    };
-
-    if (std::any_of(query.minus_words.begin(),
-                    query.minus_words.end(),
-                    lambdaCheck)) {
-        matched_words.clear();
-        return std::tuple {matched_words, documents_.at(document_id).status};
-    }
-    auto it = std::copy_if(std::execution::par,
-                           query.plus_words.begin(),
-                           query.plus_words.end(),
-                           matched_words.begin(),
-                           lambdaCheck);
-    matched_words.resize(std::distance(matched_words.begin(), it));
-    std::sort(matched_words.begin(), matched_words.end());
-    matched_words.erase(std::unique(matched_words.begin(),
-                                    matched_words.end()),
-                                    matched_words.end());
+    return std::tuple {MatchWords(ParseMatchQuery(raw_query), document_id), documents_.at(document_id).status};
+}
 
-    return std::tuple {matched_words, documents_.at(document_id).status};
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::parallel_policy, const std::string_view& raw_query, int document_id) const {
+    // A document is matched by one walk over its sorted words, there is nothing left to split between threads
+    return MatchDocument(raw_query, document_id);
 }
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::execution::sequenced_policy, const std::string_view& raw_query, int document_id) const {
-    if ((document_id < 0) || !(documents_.count(document_id))) {
-        throw std::invalid_argument("Invalid document ID"s);
+    return MatchDocument(raw_query, document_id);
+}
+
+std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> SearchServer::MatchDocuments(
+        const std::string_view& raw_query, const std::vector<int>& document_ids) const {
+    for (const int document_id : document_ids) {
+        if ((document_id < 0) || !(documents_.count(document_id))) {
+            throw std::invalid_argument("Invalid document ID"s);
+        }
     }
 
-    return MatchDocument(raw_query, document_id);
+    const MatchQuery query = ParseMatchQuery(raw_query);
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> matches;
+    matches.reserve(document_ids.size());
+    for (const int document_id : document_ids) {
+        matches.emplace_back(MatchWords(query, document_id), documents_.at(document_id).status);
+    }
+    return matches;
 }
 
-const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    if (!documents_ids_.count(document_id)) {
-        return empty_;
+std::map<std::string_view, double> SearchServer::GetWordFrequencies(int document_id) const {
+    if (!documents_.count(document_id)) {
+        return {};
     }
-    return words_freq_.at(document_id);
+    if (!forward_index_.Contains(document_id)) {
+        return snapshot_->GetWordFrequencies(document_id);
+    }
+    std::map<std::string_view, double> word_freqs;
+    const double document_length = forward_index_.GetDocumentLength(document_id);
+    const auto [first, last] = forward_index_.GetWords(document_id);
+    for (const ForwardEntry* entry = first; entry != last; ++entry) {
+        word_freqs.emplace(GetWord(entry->word_id), entry->occurrences / document_length);
+    }
+    return word_freqs;
+}
+
+std::vector<int> SearchServer::GetDocumentWordIds(int document_id) const {
+    std::vector<int> word_ids;
+    VisitDocumentWords(document_id, [&word_ids](const auto* first, const auto* last) {
+        word_ids.reserve(last - first);
+        for (; first != last; ++first) {
+            word_ids.push_back(first->word_id);
+        }
+    });
+    return word_ids;
 }
 
 void SearchServer::RemoveDocument(int document_id) {
+    RemoveDocument(std::execution::seq, document_id);
+}
 
-    for (auto [word, freq] : words_freq_.at(document_id)) {
-        word_to_document_freqs_.at(word).erase(document_id);
+void SearchServer::RemoveDocuments(const std::vector<int>& document_ids) {
+    bool is_changed = false;
+    for (const int document_id : document_ids) {
+        if (EraseDocument(std::execution::seq, document_id)) {
+            is_changed = true;
+        }
     }
-    words_freq_.erase(document_id);
-    documents_ids_.erase(document_id);
-    documents_.erase(document_id);
+    if (is_changed) {
+        RunMerges(false);
+        CompactIfChurned();
+        InvalidateResults();
+    }
+}
+
+void SearchServer::Save(const std::string& path) const {
+    IndexSnapshotWriter writer;
+    for (const std::string& word : stop_words_) {
+        writer.AddStopWord(word);
+    }
+
+    // Words left without documents are dropped, the others get new ids in text order
+    std::vector<std::pair<std::string_view, int>> words;
+    for (size_t word_id = 0; word_id < document_freqs_.size(); ++word_id) {
+        if (document_freqs_[word_id] > 0) {
+            words.emplace_back(GetWord(static_cast<int>(word_id)), static_cast<int>(word_id));
+        }
+    }
+    std::sort(words.begin(), words.end());
+    // Postings of all segments are written as one list per word
+    std::vector<const IndexSegment*> segments;
+    std::vector<const RemovedDocuments*> removed;
+    for (const SegmentView& segment : GetSegmentViews()) {
+        segments.push_back(segment.segment);
+        removed.push_back(segment.removed);
+    }
+    std::vector<int> new_word_ids(document_freqs_.size(), NO_WORD_ID);
+    for (size_t i = 0; i < words.size(); ++i) {
+        const auto [word, word_id] = words[i];
+        new_word_ids[word_id] = static_cast<int>(i);
+        writer.AddWord(word, IndexSegment::CollectPostings(word_id, segments, removed));
+    }
+
+    for (const auto& [document_id, data] : documents_) {
+        std::vector<std::pair<int, double>> document_words;
+        if (forward_index_.Contains(document_id)) {
+            const double document_length = forward_index_.GetDocumentLength(document_id);
+            const auto [first, last] = forward_index_.GetWords(document_id);
+            for (const ForwardEntry* entry = first; entry != last; ++entry) {
+                document_words.emplace_back(new_word_ids[entry->word_id], entry->occurrences / document_length);
+            }
+        } else {
+            const auto [first, last] = snapshot_->GetDocumentWords(document_id);
+            for (const SnapshotForward* entry = first; entry != last; ++entry) {
+                document_words.emplace_back(new_word_ids[entry->word_id], entry->term_freq);
+            }
+        }
+        std::sort(document_words.begin(), document_words.end());
+        const int length = GetDocumentSegment(document_id).GetDocumentLengths().Get(document_id);
+        writer.AddDocument(document_id, data.rating, data.status, length, data.words, document_words);
+    }
+    writer.Write(path);
+}
+
+SearchServer SearchServer::Load(const std::string& path) {
+    auto snapshot = std::make_shared<const IndexSnapshot>(path);
+    SearchServer server(snapshot->GetStopWords());
+    const size_t word_count = snapshot->GetWordCount();
+    server.terms_ = TermPool(static_cast<int>(word_count));
+    // The snapshot becomes the first sealed segment, its postings are read from the mapped file
+    IndexSegment::WordPostings postings;
+    postings.reserve(word_count);
+    for (size_t word_id = 0; word_id < word_count; ++word_id) {
+        PostingList list = snapshot->GetPostings(static_cast<int>(word_id));
+        server.document_freqs_.push_back(static_cast<int>(list.size()));
+        server.dead_term_count_ += list.empty() ? 1 : 0;
+        postings.emplace_back(static_cast<int>(word_id), std::move(list));
+    }
+    // Documents come sorted by id, so every document goes to the end of its page
+    std::vector<int> document_ids;
+    DocumentLengths lengths;
+    document_ids.reserve(snapshot->GetDocumentCount());
+    for (size_t i = 0; i < snapshot->GetDocumentCount(); ++i) {
+        const SnapshotDocument& document = snapshot->GetDocument(i);
+        server.documents_.Insert(document.id, DocumentData{document.rating, static_cast<DocumentStatus>(document.status),
+                                                           snapshot->GetDocumentText(i)});
+        server.status_documents_[static_cast<size_t>(document.status)].Insert(document.id);
+        document_ids.push_back(document.id);
+        lengths.Set(document.id, static_cast<int>(document.length));
+    }
+    server.sealed_segments_.push_back({std::make_shared<const IndexSegment>(std::move(postings), std::move(document_ids),
+                                                                            std::move(lengths), snapshot),
+                                       nullptr});
+    server.snapshot_ = std::move(snapshot);
+    return server;
 }
 
 bool SearchServer::IsStopWord(const std::string_view& word) const {
@@ -155,13 +613,16 @@ bool SearchServer::IsValidWord(const std::string_view& word) {
 
 std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(const std::string_view& text) const {
     std::vector<std::string_view> words;
-    for (const std::string_view& word : SplitIntoWords(text)) {
-        if (!IsValidWord(word)) {
-            throw std::invalid_argument( "Incorrect symbol in document text : ");
-        }
-        if (!IsStopWord(word)) {
-            words.push_back(word);
-        }
+    // Splitting and validation are one pass over the text
+    if (!SplitIntoValidWords(text, words)) {
+        throw std::invalid_argument( "Incorrect symbol in document text : ");
+    }
+    if (!stop_words_.empty()) {
+        words.erase(std::remove_if(words.begin(), words.end(),
+                                   [this](std::string_view word) {
+                                       return IsStopWord(word);
+                                   }),
+                    words.end());
     }
     return words;
 }
@@ -189,21 +650,66 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) cons
     return {text, is_minus};
 }
 
-SearchServer::Query SearchServer::ParseQuery(const std::string_view& text, bool policy_par) const {
+SearchServer::Query SearchServer::ParseQuery(const std::string_view& text) const {
+    Query query = ParseQueryWords(text);
+    for (const std::string_view& word : query.plus_words) {
+        query.plus_word_ids.push_back(FindWordId(word));
+    }
+    for (const std::string_view& word : query.minus_words) {
+        query.minus_word_ids.push_back(FindWordId(word));
+    }
+    ExpandPrefixes(query);
+    ResolvePhrases(query);
+    return query;
+}
+
+SearchServer::Query SearchServer::ParseQueryWords(const std::string_view& text) const {
     Query query;
 
-    for (const std::string_view& word : SplitIntoWordsNoStop(text)) {
-        const QueryWord query_word = ParseQueryWord(word);
-        if (query_word.is_minus) {
-            query.minus_words.push_back(query_word.data);
-        } else {
-            query.plus_words.push_back(query_word.data);
+    // Quoted parts are phrases, the text around them is taken word by word
+    std::string_view rest = text;
+    while (!rest.empty()) {
+        const size_t open = rest.find('"');
+        for (const std::string_view& word : SplitIntoWordsNoStop(rest.substr(0, open))) {
+            const QueryWord query_word = ParseQueryWord(word);
+            if (query_word.data.back() == '*') {
+                if (query_word.data.size() == 1) {
+                    throw std::invalid_argument("Incorrect prefix query (empty)");
+                }
+                const std::string_view prefix = query_word.data.substr(0, query_word.data.size() - 1);
+                (query_word.is_minus ? query.minus_prefixes : query.plus_prefixes).push_back(prefix);
+            } else if (query_word.is_minus) {
+                query.minus_words.push_back(query_word.data);
+            } else {
+                query.plus_words.push_back(query_word.data);
+            }
+        }
+        if (open == std::string_view::npos) {
+            break;
+        }
+        const size_t close = rest.find('"', open + 1);
+        if (close == std::string_view::npos) {
+            throw std::invalid_argument("Incorrect phrase query (no closing quote)");
+        }
+        std::vector<std::string_view> phrase = SplitIntoWordsNoStop(rest.substr(open + 1, close - open - 1));
+        for (const std::string_view& word : phrase) {
+            if (ParseQueryWord(word).is_minus) {
+                throw std::invalid_argument("Incorrect phrase query (minus word)");
+            }
+        }
+        query.plus_words.insert(query.plus_words.end(), phrase.begin(), phrase.end());
+        // A single word needs no positions
+        if (phrase.size() > 1) {
+            query.phrases.push_back(std::move(phrase));
         }
+        rest = rest.substr(close + 1);
     }
-
-    if (policy_par) {
-        return query;
+    for (std::vector<std::string_view>* prefixes : {&query.plus_prefixes, &query.minus_prefixes}) {
+        std::sort(prefixes->begin(), prefixes->end());
+        prefixes->erase(std::unique(prefixes->begin(), prefixes->end()), prefixes->end());
     }
+    std::sort(query.phrases.begin(), query.phrases.end());
+    query.phrases.erase(std::unique(query.phrases.begin(), query.phrases.end()), query.phrases.end());
 
     std::sort(query.minus_words.begin(),
               query.minus_words.end());
@@ -219,8 +725,464 @@ SearchServer::Query SearchServer::ParseQuery(const std::string_view& text, bool
     return query;
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(const std::string_view& word) const {
-    return log(static_cast<double>(GetDocumentCount()) * 1.0 / static_cast<double>(word_to_document_freqs_.at(word).size()));
+SearchServer::MatchQuery SearchServer::ParseMatchQuery(const std::string_view& raw_query) const {
+    const Query query = ParseQuery(raw_query);
+    MatchQuery match_query;
+    std::vector<std::pair<int, std::string_view>> plus_words;
+    for (size_t i = 0; i < query.plus_words.size(); ++i) {
+        if (query.plus_word_ids[i] != NO_WORD_ID) {
+            plus_words.emplace_back(query.plus_word_ids[i], query.plus_words[i]);
+        }
+    }
+    // Words of prefixes are reported as the dictionary has them, a word may come from several prefixes
+    for (const std::vector<int>& word_ids : query.plus_prefix_word_ids) {
+        for (const int word_id : word_ids) {
+            plus_words.emplace_back(word_id, GetWord(word_id));
+        }
+    }
+    std::sort(plus_words.begin(), plus_words.end());
+    plus_words.erase(std::unique(plus_words.begin(), plus_words.end()), plus_words.end());
+    for (const auto& [word_id, word] : plus_words) {
+        match_query.plus_word_ids.push_back(word_id);
+        match_query.plus_words.push_back(word);
+    }
+    for (const int word_id : query.minus_word_ids) {
+        if (word_id != NO_WORD_ID) {
+            match_query.minus_word_ids.push_back(word_id);
+        }
+    }
+    std::sort(match_query.minus_word_ids.begin(), match_query.minus_word_ids.end());
+    match_query.phrase_word_ids = query.phrase_word_ids;
+    return match_query;
+}
+
+std::vector<std::string_view> SearchServer::MatchWords(const MatchQuery& query, int document_id) const {
+    std::vector<std::string_view> matched_words;
+    VisitDocumentWords(document_id, [&](const auto* first, const auto* last) {
+        bool has_minus_word = false;
+        IntersectWordIds(first, last, query.minus_word_ids, [&has_minus_word](size_t) {
+            has_minus_word = true;
+        });
+        if (has_minus_word) {
+            return;
+        }
+        for (const std::vector<int>& phrase : query.phrase_word_ids) {
+            if (!position_index_->ContainsPhrase(document_id, phrase)) {
+                return;
+            }
+        }
+        IntersectWordIds(first, last, query.plus_word_ids, [&](size_t i) {
+            matched_words.push_back(query.plus_words[i]);
+        });
+    });
+    // Ids follow the order words came to the dictionary, callers get the words sorted as in the query
+    std::sort(matched_words.begin(), matched_words.end());
+    return matched_words;
+}
+
+double SearchServer::ComputeWordInverseDocumentFreq(int word_id) const {
+    return log(static_cast<double>(GetDocumentCount()) * 1.0 / static_cast<double>(document_freqs_[word_id]));
+}
+
+int SearchServer::GetOrAddWordId(std::string_view word) {
+    if (snapshot_) {
+        const int word_id = snapshot_->FindWord(word);
+        if (word_id != NO_WORD_ID) {
+            return word_id;
+        }
+    }
+    const int word_id = terms_.Add(word);
+    if (static_cast<size_t>(word_id) == document_freqs_.size()) {
+        // Dead until the document that brought it gets its postings
+        document_freqs_.push_back(0);
+        ++dead_term_count_;
+    }
+    return word_id;
+}
+
+std::string_view SearchServer::GetWord(int word_id) const {
+    if (snapshot_ && static_cast<size_t>(word_id) < snapshot_->GetWordCount()) {
+        return snapshot_->GetWord(word_id);
+    }
+    return terms_.Get(word_id);
+}
+
+int SearchServer::FindWordId(std::string_view word) const {
+    const int word_id = terms_.Find(word);
+    if (word_id != NO_WORD_ID || !snapshot_) {
+        return word_id;
+    }
+    return snapshot_->FindWord(word);
+}
+
+void SearchServer::ExpandPrefixes(Query& query) const {
+    for (const std::string_view prefix : query.plus_prefixes) {
+        query.plus_prefix_word_ids.push_back(FindWordIdsByPrefix(prefix));
+    }
+    for (const std::string_view prefix : query.minus_prefixes) {
+        const std::vector<int> word_ids = FindWordIdsByPrefix(prefix);
+        query.minus_word_ids.insert(query.minus_word_ids.end(), word_ids.begin(), word_ids.end());
+    }
+}
+
+std::vector<int> SearchServer::FindWordIdsByPrefix(std::string_view prefix) const {
+    std::vector<int> word_ids;
+    if (snapshot_) {
+        const auto [first, last] = snapshot_->FindWordPrefix(prefix);
+        for (int word_id = first; word_id < last; ++word_id) {
+            word_ids.push_back(word_id);
+        }
+    }
+    terms_.FindPrefix(prefix, word_ids);
+    word_ids.erase(std::remove_if(word_ids.begin(), word_ids.end(),
+                                  [this](int word_id) {
+                                      return GetDocumentFreq(word_id) == 0;
+                                  }),
+                   word_ids.end());
+    return word_ids;
+}
+
+std::vector<SearchServer::QueryTerm> SearchServer::GetPlusTerms(const Query& query) const {
+    std::vector<QueryTerm> terms;
+    for (size_t i = 0; i < query.plus_word_ids.size(); ++i) {
+        const int word_id = query.plus_word_ids[i];
+        if (GetDocumentFreq(word_id) > 0) {
+            terms.push_back({word_id, ComputeWordInverseDocumentFreq(word_id), i});
+        }
+    }
+    for (size_t i = 0; i < query.plus_prefix_word_ids.size(); ++i) {
+        const std::vector<int>& word_ids = query.plus_prefix_word_ids[i];
+        // The documents of the most frequent word stand for the documents of the prefix, a lower bound
+        // that needs no pass over the postings
+        int document_freq = 0;
+        for (const int word_id : word_ids) {
+            document_freq = std::max(document_freq, GetDocumentFreq(word_id));
+        }
+        if (document_freq == 0) {
+            continue;
+        }
+        const double inverse_document_freq = log(static_cast<double>(GetDocumentCount()) / document_freq);
+        for (const int word_id : word_ids) {
+            terms.push_back({word_id, inverse_document_freq, query.plus_word_ids.size() + i});
+        }
+    }
+    return terms;
+}
+
+void SearchServer::ResolvePhrases(Query& query) const {
+    if (query.phrases.empty()) {
+        return;
+    }
+    if (!position_index_) {
+        throw std::invalid_argument("Phrase queries need the positional index");
+    }
+    for (const std::vector<std::string_view>& phrase : query.phrases) {
+        std::vector<int>& word_ids = query.phrase_word_ids.emplace_back();
+        for (const std::string_view word : phrase) {
+            word_ids.push_back(FindWordId(word));
+        }
+    }
+}
+
+std::optional<std::vector<int>> SearchServer::FindPhraseDocuments(const Query& query) const {
+    if (query.phrase_word_ids.empty()) {
+        return std::nullopt;
+    }
+    int rarest_word_id = NO_WORD_ID;
+    for (const std::vector<int>& phrase : query.phrase_word_ids) {
+        for (const int word_id : phrase) {
+            if (GetDocumentFreq(word_id) == 0) {
+                return std::vector<int>{};
+            }
+            if (rarest_word_id == NO_WORD_ID || GetDocumentFreq(word_id) < GetDocumentFreq(rarest_word_id)) {
+                rarest_word_id = word_id;
+            }
+        }
+    }
+    std::vector<int> documents;
+    for (const SegmentView& segment : GetSegmentViews()) {
+        const PostingList* postings = segment.segment->GetPostings(rarest_word_id);
+        if (postings == nullptr) {
+            continue;
+        }
+        postings->ForEach(segment.segment->GetDocumentLengths(), [&](const Posting& posting) {
+            if (!segment.IsRemoved(posting.document_id) &&
+                std::all_of(query.phrase_word_ids.begin(), query.phrase_word_ids.end(),
+                            [&](const std::vector<int>& phrase) {
+                                return position_index_->ContainsPhrase(posting.document_id, phrase);
+                            })) {
+                documents.push_back(posting.document_id);
+            }
+        });
+    }
+    // Segments hold interleaving ranges of ids
+    std::sort(documents.begin(), documents.end());
+    return documents;
+}
+
+std::vector<SearchServer::SegmentView> SearchServer::GetSegmentViews() const {
+    std::vector<SegmentView> segments;
+    segments.reserve(sealed_segments_.size() + 1);
+    for (const SealedSegment& sealed : sealed_segments_) {
+        segments.push_back({sealed.segment.get(), sealed.removed.get()});
+    }
+    segments.push_back({&mutable_segment_, nullptr});
+    return segments;
+}
+
+const IndexSegment& SearchServer::GetDocumentSegment(int document_id) const {
+    if (mutable_segment_.HasDocument(document_id)) {
+        return mutable_segment_;
+    }
+    // A removed document may come back in a newer segment, its old postings stay in older ones
+    for (auto it = sealed_segments_.rbegin(); it != sealed_segments_.rend(); ++it) {
+        if (it->segment->HasDocument(document_id) && (!it->removed || it->removed->count(document_id) == 0)) {
+            return *it->segment;
+        }
+    }
+    return mutable_segment_;
+}
+
+int SearchServer::GetDocumentFreq(int word_id) const {
+    return word_id == NO_WORD_ID ? 0 : document_freqs_[word_id];
+}
+
+std::vector<SearchServer::DocumentRange> SearchServer::SplitIntoDocumentRanges(const std::vector<const PostingList*>& postings,
+                                                                               size_t max_range_count) {
+    // Range bounds are quantiles of the first ids of all compressed blocks. Blocks hold about the same
+    // number of postings, so a long list gets proportionally more samples and spreads evenly over the ranges.
+    size_t total_size = 0;
+    for (const PostingList* list : postings) {
+        total_size += list->size();
+    }
+    const size_t range_count = std::max<size_t>(1, std::min(max_range_count, total_size / 1024));
+    if (range_count == 1) {
+        return {ALL_DOCUMENTS};
+    }
+    std::vector<int> sample;
+    for (const PostingList* list : postings) {
+        for (size_t block = 0; block < list->GetBlockCount(); ++block) {
+            sample.push_back(list->GetBlockFirstId(block));
+        }
+    }
+    std::sort(sample.begin(), sample.end());
+
+    std::vector<DocumentRange> ranges;
+    int64_t first_id = ALL_DOCUMENTS.first_id;
+    for (size_t i = 1; i < range_count; ++i) {
+        const int64_t bound = sample[i * sample.size() / range_count];
+        if (bound > first_id) {
+            ranges.push_back({first_id, bound});
+            first_id = bound;
+        }
+    }
+    ranges.push_back({first_id, ALL_DOCUMENTS.last_id});
+    return ranges;
+}
+
+void SearchServer::InsertPosting(int word_id, const PostingEntry& entry) {
+    mutable_segment_.InsertPosting(word_id, entry);
+    AddDocumentFreq(word_id, 1);
+}
+
+void SearchServer::AddDocumentFreq(int word_id, int delta) {
+    int& document_freq = document_freqs_.GetMutable(word_id);
+    if (document_freq == 0) {
+        --dead_term_count_;
+    }
+    document_freq += delta;
+    if (document_freq == 0) {
+        ++dead_term_count_;
+    }
+}
+
+void SearchServer::CompactIfChurned() {
+    // Dead words of the snapshot may come back to life, so the count can fall below the kept one
+    if (max_dead_term_share_ < 1.0
+        && static_cast<double>(dead_term_count_) > static_cast<double>(kept_dead_term_count_)
+                                                   + max_dead_term_share_ * static_cast<double>(document_freqs_.size())) {
+        Compact();
+    }
+}
+
+bool SearchServer::MarkRemovedInSealedSegment(int document_id) {
+    for (auto it = sealed_segments_.rbegin(); it != sealed_segments_.rend(); ++it) {
+        if (!it->segment->HasDocument(document_id) || (it->removed && it->removed->count(document_id) > 0)) {
+            continue;
+        }
+        // A set held only here is not seen by any other version, so it can be changed in place once
+        // the fence orders the reads of versions that released it before the change, as in SharedPages
+        if (!it->removed || it->removed.use_count() > 1) {
+            it->removed = it->removed ? std::make_shared<RemovedDocuments>(*it->removed)
+                                      : std::make_shared<RemovedDocuments>();
+        } else {
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        it->removed->insert(document_id);
+        return true;
+    }
+    return false;
+}
+
+void SearchServer::SealIfFull() {
+    if (mutable_segment_.GetPostingCount() >= segment_options_.max_mutable_postings) {
+        mutable_segment_.Seal();
+        sealed_segments_.push_back({std::make_shared<const IndexSegment>(std::move(mutable_segment_)), nullptr});
+        mutable_segment_ = IndexSegment();
+    }
+    RunMerges(false);
+}
+
+void SearchServer::RunMerges(bool wait) {
+    while (true) {
+        if (pending_merge_) {
+            if (!wait && segment_options_.background_merge
+                && pending_merge_->result.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+                return;
+            }
+            InstallMerge();
+        }
+
+        // Size-tiered policy: the oldest run of merge_factor neighbouring segments of one tier is merged.
+        // Otherwise a segment with a quarter of its documents removed is rewritten without them.
+        const size_t factor = segment_options_.merge_factor;
+        std::vector<size_t> tiers;
+        for (const SealedSegment& sealed : sealed_segments_) {
+            size_t tier = 0;
+            for (size_t bound = segment_options_.max_mutable_postings * factor;
+                 sealed.segment->GetPostingCount() >= bound && tier < 64; bound *= factor) {
+                ++tier;
+            }
+            tiers.push_back(tier);
+        }
+        std::optional<std::pair<size_t, size_t>> merge;
+        for (size_t first = 0, last = 0; first < tiers.size() && !merge; first = last) {
+            for (last = first; last < tiers.size() && tiers[last] == tiers[first]; ++last) {
+            }
+            if (last - first >= factor) {
+                merge = std::pair{first, factor};
+            }
+        }
+        for (size_t i = 0; i < sealed_segments_.size() && !merge; ++i) {
+            const SealedSegment& sealed = sealed_segments_[i];
+            if (sealed.removed && sealed.removed->size() * 4 >= sealed.segment->GetDocumentCount()) {
+                merge = std::pair{i, size_t{1}};
+            }
+        }
+        if (!merge) {
+            return;
+        }
+        StartMerge(merge->first, merge->second);
+        if (!wait && segment_options_.background_merge) {
+            return;
+        }
+    }
+}
+
+void SearchServer::StartMerge(size_t first, size_t count) {
+    PendingMerge merge{first, {sealed_segments_.begin() + first, sealed_segments_.begin() + first + count}, {}};
+    // The task holds its own references, the server may be moved or forked while it runs
+    std::vector<std::shared_ptr<const IndexSegment>> segments;
+    std::vector<std::shared_ptr<const RemovedDocuments>> removed;
+    for (const SealedSegment& input : merge.inputs) {
+        segments.push_back(input.segment);
+        removed.push_back(input.removed);
+    }
+    merge.result = std::async(segment_options_.background_merge ? std::launch::async : std::launch::deferred,
+                              [segments = std::move(segments), removed = std::move(removed)]() {
+                                  std::vector<const IndexSegment*> segment_ptrs;
+                                  std::vector<const RemovedDocuments*> removed_ptrs;
+                                  for (size_t i = 0; i < segments.size(); ++i) {
+                                      segment_ptrs.push_back(segments[i].get());
+                                      removed_ptrs.push_back(removed[i].get());
+                                  }
+                                  return std::make_shared<const IndexSegment>(
+                                          IndexSegment::Merge(segment_ptrs, removed_ptrs));
+                              }).share();
+    pending_merge_ = std::move(merge);
+}
+
+void SearchServer::InstallMerge() {
+    PendingMerge merge = std::move(*pending_merge_);
+    pending_merge_.reset();
+    // Documents removed while the merge ran still have postings in the merged segment
+    std::shared_ptr<RemovedDocuments> removed;
+    for (size_t i = 0; i < merge.inputs.size(); ++i) {
+        const SealedSegment& input = merge.inputs[i];
+        const SealedSegment& current = sealed_segments_[merge.first + i];
+        if (current.removed == input.removed) {
+            continue;
+        }
+        for (const int document_id : *current.removed) {
+            if (!input.removed || input.removed->count(document_id) == 0) {
+                if (!removed) {
+                    removed = std::make_shared<RemovedDocuments>();
+                }
+                removed->insert(document_id);
+            }
+        }
+    }
+    const auto first = sealed_segments_.begin() + merge.first;
+    sealed_segments_.erase(first + 1, first + merge.inputs.size());
+    std::shared_ptr<const IndexSegment> merged = merge.result.get();
+    if (merged->GetDocumentCount() == 0) {
+        sealed_segments_.erase(first);
+    } else {
+        *first = {std::move(merged), std::move(removed)};
+    }
+}
+
+const SearchServer::QueryMetrics& SearchServer::GetQueryMetrics() {
+    static const QueryMetrics metrics = [] {
+        MetricsRegistry& registry = GetMetrics();
+        return QueryMetrics{registry.GetHistogramId("query.parse"sv),
+                            registry.GetHistogramId("query.posting_fetch"sv),
+                            registry.GetHistogramId("query.scoring"sv),
+                            registry.GetHistogramId("query.top_k"sv),
+                            registry.GetHistogramId("query.result_build"sv),
+                            registry.GetCounterId("query.count"sv),
+                            registry.GetCounterId("query.postings"sv)};
+    }();
+    return metrics;
+}
+
+void SearchServer::InvalidateResults() {
+    if (result_cache_) {
+        result_generation_ = result_cache_->Invalidate();
+    }
+}
+
+std::string SearchServer::MakeResultCacheKey(const Query& query, DocumentStatus status, size_t max_count) {
+    // Words hold neither spaces nor a leading '-' nor a trailing '*', so the key cannot be split another way
+    std::string key = std::to_string(static_cast<int>(status)) + ' ' + std::to_string(max_count);
+    for (const std::string_view word : query.plus_words) {
+        key += ' ';
+        key += word;
+    }
+    for (const std::string_view word : query.minus_words) {
+        key += " -"s;
+        key += word;
+    }
+    for (const std::string_view prefix : query.plus_prefixes) {
+        key += ' ';
+        key += prefix;
+        key += '*';
+    }
+    for (const std::string_view prefix : query.minus_prefixes) {
+        key += " -"s;
+        key += prefix;
+        key += '*';
+    }
+    // Words of a query never hold quotes
+    for (const std::vector<std::string_view>& phrase : query.phrases) {
+        key += " \"";
+        for (size_t i = 0; i < phrase.size(); ++i) {
+            key += i == 0 ? ""s : " "s;
+            key += phrase[i];
+        }
+        key += '"';
+    }
+    return key;
 }
 
 std::ostream& operator<<(std::ostream& os, const Document& v) {
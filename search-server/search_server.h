@@ -3,22 +3,68 @@
 #include "string_processing.h"
 #include "paginator.h"
 #include "concurrent_map.h"
+#include "top_documents.h"
+#include "relevance_accumulator.h"
+#include "query_batch.h"
+#include "posting_list.h"
+#include "index_segment.h"
+#include "forward_index.h"
+#include "position_index.h"
+#include "document_bitmap.h"
+#include "index_snapshot.h"
+#include "text_arena.h"
+#include "shared_pages.h"
+#include "term_pool.h"
+#include "result_cache.h"
+#include "memory_stats.h"
+#include "metrics.h"
 #include <set>
+#include <array>
 #include <algorithm>
 #include <string>
 #include <map>
+#include <unordered_map>
+#include <vector>
 #include <list>
+#include <memory>
+#include <future>
+#include <optional>
 #include <stdexcept>
 #include <iostream>
 #include <execution>
 #include <type_traits>
+#include <numeric>
+#include <thread>
+#include <limits>
 
-constexpr double EPSILON = 1e-6;
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
+
+// PRUNED skips documents that provably cannot reach the current top results (MaxScore),
+// it returns the same documents as EXHAUSTIVE.
+enum class QueryEvaluation {
+    EXHAUSTIVE,
+    PRUNED,
+};
+
+// New documents go to a small mutable segment of the index. Once it holds max_mutable_postings postings
+// it is sealed, and sealed segments are merged on a size-tiered policy: segments of a tier hold up to
+// merge_factor times more postings than those of the tier below, and merge_factor neighbouring segments
+// of one tier are merged into one segment of the next tier.
+struct SegmentOptions {
+    size_t max_mutable_postings = 1 << 16;
+    size_t merge_factor = 4;
+    // Otherwise merges run right after sealing, in the call that sealed
+    bool background_merge = true;
+};
 using namespace std::literals;
 
 class SearchServer {
+    struct DocumentData;
+
 public:
+    // Iterates over the ids of the documents in ascending order
+    using DocumentIdIterator = SharedIdMap<DocumentData>::id_iterator;
+
     template<typename TypeStop>
     explicit SearchServer(const TypeStop& stopwords);
 
@@ -26,57 +72,204 @@ public:
 
     explicit SearchServer(const std::string_view& stopwords);
 
-    std::set<int>::const_iterator begin() const;
+    SearchServer(SearchServer&&) = default;
 
-    std::set<int>::const_iterator end() const;
+    SearchServer& operator=(SearchServer&&) = default;
+
+    // Waits for a background merge in progress
+    ~SearchServer();
+
+    // Copy of the server that can be changed independently, also from another thread. Texts of documents and words
+    // are shared with the original, as they are never changed once stored. Sealed segments, the forward and positional
+    // indexes, documents, status bitmaps, document frequencies and the dictionary are kept in pages shared
+    // between forks, a fork copies a page when it first changes it. The mutable segment is copied whole.
+    // The server must not be changed while it is being forked.
+    SearchServer Fork() const;
+
+    DocumentIdIterator begin() const;
+
+    DocumentIdIterator end() const;
 
     void AddDocument(int document_id, const std::string_view& document, DocumentStatus status,
                      const std::vector<int>& ratings);
 
+    struct NewDocument {
+        int id;
+        std::string_view text;
+        DocumentStatus status;
+        std::vector<int> ratings;
+    };
+
+    // Adds many documents at once: texts are tokenized in parallel and merged into the index in one pass.
+    // Throws std::invalid_argument like AddDocument, and then none of the documents is added.
+    void AddDocuments(const std::vector<NewDocument>& documents);
+
+    // max_count limits the number of returned documents, best ones first. A query word ending with '*' stands for
+    // every word starting with the rest of it, and the words it stands for are scored together as one plus word.
     template <typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(const std::string_view& raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(const std::string_view& raw_query, DocumentPredicate document_predicate,
+                                           size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
-    std::vector<Document> FindTopDocuments(const std::string_view& raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(const std::string_view& raw_query, DocumentStatus status,
+                                           size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     std::vector<Document> FindTopDocuments(const std::string_view& raw_query) const;
 
     template <typename DocumentPredicate, class Execution>
-    std::vector<Document> FindTopDocuments(Execution&& policy, const std::string_view& raw_query, DocumentPredicate document_predicate) const;
+    std::vector<Document> FindTopDocuments(Execution&& policy, const std::string_view& raw_query, DocumentPredicate document_predicate,
+                                           size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     template <class Execution>
-    std::vector<Document> FindTopDocuments(Execution&& policy, const std::string_view& raw_query, DocumentStatus status) const;
+    std::vector<Document> FindTopDocuments(Execution&& policy, const std::string_view& raw_query, DocumentStatus status,
+                                           size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
 
     template <class Execution>
     std::vector<Document> FindTopDocuments(Execution&& policy, const std::string_view& raw_query) const;
 
+    // Page of page_size results following the document `after` in the order of FindTopDocuments, std::nullopt
+    // gives the first page and the last document of a page gives the next one. The query is scored anew and only
+    // page_size documents are kept in the heap, so a deep page costs as much as the first one.
+    // If documents change between pages, relevances shift and pages may skip or repeat documents.
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsAfter(const std::string_view& raw_query, DocumentPredicate document_predicate,
+                                                const std::optional<Document>& after, size_t page_size) const;
+
+    template <typename DocumentPredicate, class Execution>
+    std::vector<Document> FindTopDocumentsAfter(Execution&& policy, const std::string_view& raw_query,
+                                                DocumentPredicate document_predicate,
+                                                const std::optional<Document>& after, size_t page_size) const;
+
+    // Answers many queries for ACTUAL documents at once. Repeated queries are computed once,
+    // every distinct word is looked up once, and queries are spread over threads by estimated cost.
+    QueryBatchResult FindTopDocumentsBatch(const std::vector<std::string>& raw_queries,
+                                           size_t max_count = MAX_RESULT_DOCUMENT_COUNT) const;
+
     size_t GetDocumentCount() const;
 
+    void SetQueryEvaluation(QueryEvaluation evaluation);
+
+    // Keeps the positions of words in documents, which quoted phrases of queries need: "white cat" matches
+    // documents where the words come one right after another, stop words left out. Positions of documents
+    // already in the server are found by tokenizing their texts once. Snapshots do not keep positions,
+    // so a loaded server starts without them. false drops the positions.
+    void SetPositionalIndex(bool enabled);
+
+    // Caches results of FindTopDocuments called with a status, keeping them within about max_bytes of memory.
+    // 0 turns the cache off. Adding or removing documents invalidates all cached results.
+    // Calls with a predicate are never cached.
+    void SetResultCacheSize(size_t max_bytes);
+
+    ResultCacheStats GetResultCacheStats() const;
+
+    void SetSegmentOptions(const SegmentOptions& options);
+
+    // Installs the merge in progress and runs every merge that is due, blocking until they are done
+    void WaitForMerges();
+
+    // Sealed segments and the mutable one
+    size_t GetSegmentCount() const;
+
+    MemoryStats GetMemoryStats() const;
+
+    // Drops terms no document has any more and renumbers the others densely, rewrites segments without
+    // the postings of removed documents and copies texts of documents into storage without removed ones.
+    // Results do not change. Views returned earlier by MatchDocument and GetWordFrequencies become invalid.
+    void Compact();
+
+    // Runs Compact after a removal once dead terms make up more than max_dead_term_share of the dictionary.
+    // Terms of a loaded snapshot that die are not counted, Compact cannot drop them. 1 turns it off.
+    void SetAutoCompaction(double max_dead_term_share);
+
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(const std::string_view& raw_query, int document_id) const;
 
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::parallel_policy, const std::string_view& raw_query, int document_id) const;
 
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::execution::sequenced_policy, const std::string_view& raw_query, int document_id) const;
 
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    // Words of many documents matched against one query, parsed once. Results go in the order of document_ids.
+    // Throws std::invalid_argument like MatchDocument if any of the documents is missing.
+    std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(
+            const std::string_view& raw_query, const std::vector<int>& document_ids) const;
+
+    // Built from the forward index on every call, an empty map for documents missing from the server
+    std::map<std::string_view, double> GetWordFrequencies(int document_id) const;
+
+    // Dictionary ids of the words of the document, ascending, empty for documents missing from the server.
+    // Equal words of different documents have equal ids until the next Compact.
+    std::vector<int> GetDocumentWordIds(int document_id) const;
 
     void RemoveDocument(int document_id);
 
     template<class Execution>
     void RemoveDocument(Execution&& policy, int document_id);
 
+    // Removes all the documents at once, merges, compaction and invalidation of cached results run once
+    // for the whole batch. Ids missing from the server are skipped.
+    void RemoveDocuments(const std::vector<int>& document_ids);
+
+    // Writes stop words, dictionary, postings and documents to a versioned binary snapshot.
+    // Throws std::runtime_error if the file cannot be written.
+    void Save(const std::string& path) const;
+
+    // Maps a snapshot written by Save. Dictionary, postings and texts are read straight from the mapped file
+    // until they change, nothing is tokenized again. Throws std::runtime_error for unreadable or foreign files.
+    static SearchServer Load(const std::string& path);
+
 private:
     struct DocumentData {
         int rating;
         DocumentStatus status;
-        std::string words;
+        // Text of the document, stored in document_texts_ or in the loaded snapshot
+        std::string_view words;
     };
 
-    std::set<int> documents_ids_;
+    // Only forks are copies, copying shares pages and texts with the original and is asked for by name
+    SearchServer(const SearchServer&) = default;
+
+    SearchServer& operator=(const SearchServer&) = delete;
+
     std::set<std::string, std::less<>> stop_words_;
-    std::map<int, std::map<std::string_view , double>> words_freq_;
-    std::map<std::string_view, double> empty_;
-    std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-    std::map<int, DocumentData> documents_;
+    // Word ids and occurrences of every document added after loading
+    ForwardIndex forward_index_;
+    // Positions of words in every document, kept only while the positional index is on
+    std::optional<PositionIndex> position_index_;
+    // Term dictionary: every distinct word gets a dense id indexing into postings_
+    TermPool terms_;
+    // Shared with forks, stored texts never move
+    std::shared_ptr<TextArena> document_texts_ = std::make_shared<TextArena>();
+    // Inverted index: sealed segments from the oldest to the newest, then the mutable segment taking new documents.
+    // Removed sets are shared with forks and merges in progress, a set held elsewhere is copied before a change.
+    struct SealedSegment {
+        std::shared_ptr<const IndexSegment> segment;
+        std::shared_ptr<RemovedDocuments> removed;
+    };
+    std::vector<SealedSegment> sealed_segments_;
+    IndexSegment mutable_segment_;
+    // Number of documents having the word, by word id. Segments keep postings of removed documents,
+    // so the document frequency for IDF is counted here for the whole index.
+    SharedVector<int> document_freqs_;
+    // Words whose document frequency is 0, and how many of them Compact had to keep
+    size_t dead_term_count_ = 0;
+    size_t kept_dead_term_count_ = 0;
+    double max_dead_term_share_ = 1.0;
+    SegmentOptions segment_options_;
+    // Merge of sealed_segments_[first, first + inputs.size()), inputs keep their removed sets as of the start
+    struct PendingMerge {
+        size_t first;
+        std::vector<SealedSegment> inputs;
+        std::shared_future<std::shared_ptr<const IndexSegment>> result;
+    };
+    std::optional<PendingMerge> pending_merge_;
+    SharedIdMap<DocumentData> documents_;
+    // Ids of the documents of every status, indexed by DocumentStatus
+    std::array<DocumentBitmap, 4> status_documents_;
+    // Snapshot the server was loaded from. Its words take ids [0, word count), later words are kept in terms_.
+    // Documents of the snapshot are not in forward_index_, their words are read from the snapshot.
+    std::shared_ptr<const IndexSnapshot> snapshot_;
+    QueryEvaluation query_evaluation_ = QueryEvaluation::EXHAUSTIVE;
+    // Shared with forks, every fork looks up results of its own generation
+    std::shared_ptr<ResultCache> result_cache_;
+    uint64_t result_generation_ = 0;
 
     bool IsStopWord(const std::string_view& word) const;
 
@@ -93,26 +286,184 @@ private:
 
     QueryWord ParseQueryWord(std::string_view text) const;
 
+    static constexpr int NO_WORD_ID = -1;
+
     struct Query {
         std::vector<std::string_view> plus_words;
         std::vector<std::string_view> minus_words;
+        // Dictionary ids of the words above, NO_WORD_ID for words missing from the index.
+        // minus_word_ids goes on with the words of minus prefixes.
+        std::vector<int> plus_word_ids;
+        std::vector<int> minus_word_ids;
+        // Query words ending with '*', without it
+        std::vector<std::string_view> plus_prefixes;
+        std::vector<std::string_view> minus_prefixes;
+        // Ids of the words of every plus prefix that some document has
+        std::vector<std::vector<int>> plus_prefix_word_ids;
+        // Quoted phrases of two words or more, sorted. Their words are plus words as well.
+        std::vector<std::vector<std::string_view>> phrases;
+        std::vector<std::vector<int>> phrase_word_ids;
     };
 
-    Query ParseQuery(const std::string_view& text, bool policy_par = false) const;
+    // Throws std::invalid_argument for a quote without a pair, for minus words inside quotes and for a bare '*'
+    Query ParseQuery(const std::string_view& text) const;
+
+    Query ParseQueryWords(const std::string_view& text) const;
 
-    double ComputeWordInverseDocumentFreq(const std::string_view& word) const;
+    // Words of a query found in the dictionary, sorted by id to be intersected with forward index entries
+    struct MatchQuery {
+        std::vector<int> plus_word_ids;
+        // Words of plus_word_ids, in the same order
+        std::vector<std::string_view> plus_words;
+        std::vector<int> minus_word_ids;
+        std::vector<std::vector<int>> phrase_word_ids;
+    };
 
+    MatchQuery ParseMatchQuery(const std::string_view& raw_query) const;
+
+    // Plus words of the query the document has, in text order, none if it has a minus word or lacks a phrase
+    std::vector<std::string_view> MatchWords(const MatchQuery& query, int document_id) const;
+
+    // Calls action(first, last) with the forward entries of the document, sorted by word id.
+    // Entries of snapshot documents are read from the snapshot and have their own type.
+    template <typename Action>
+    void VisitDocumentWords(int document_id, Action action) const;
+
+    int FindWordId(std::string_view word) const;
+
+    // Word ids for the phrases of the query. Throws std::invalid_argument if there are phrases
+    // and the positional index is off.
+    void ResolvePhrases(Query& query) const;
+
+    // Ids of the words of the prefixes of the query
+    void ExpandPrefixes(Query& query) const;
+
+    // Ids of the words starting with the prefix that some document has, in time of the number of words found
+    std::vector<int> FindWordIdsByPrefix(std::string_view prefix) const;
+
+    // Plus word or word of a plus prefix. Words of a prefix share its index and IDF, so they are scored
+    // as one word having all their occurrences.
+    struct QueryTerm {
+        int word_id;
+        double inverse_document_freq;
+        size_t index;
+    };
+
+    // Terms of the query that some document has, plus words first, in the order of the query
+    std::vector<QueryTerm> GetPlusTerms(const Query& query) const;
+
+    // Sorted ids of the documents having every phrase of the query, std::nullopt for a query without phrases.
+    // Candidates are the documents of the rarest phrase word, their positions are checked without their texts.
+    std::optional<std::vector<int>> FindPhraseDocuments(const Query& query) const;
+
+    // Segment of the index together with the documents its readers skip
+    struct SegmentView {
+        const IndexSegment* segment;
+        const RemovedDocuments* removed;
+
+        bool IsRemoved(int document_id) const {
+            return removed != nullptr && removed->count(document_id) > 0;
+        }
+    };
+
+    std::vector<SegmentView> GetSegmentViews() const;
+
+    // Segment holding the postings of a document of the server
+    const IndexSegment& GetDocumentSegment(int document_id) const;
+
+    // Number of documents having the word, 0 for NO_WORD_ID
+    int GetDocumentFreq(int word_id) const;
+
+    double ComputeWordInverseDocumentFreq(int word_id) const;
+
+    int GetOrAddWordId(std::string_view word);
+
+    std::string_view GetWord(int word_id) const;
+
+    void InsertPosting(int word_id, const PostingEntry& entry);
+
+    // Removes the document without the follow-up work of RemoveDocument, false if there is no such document
+    template<class Execution>
+    bool EraseDocument(Execution&& policy, int document_id);
+
+    // Adds to the document frequency of a word, keeping the count of dead terms
+    void AddDocumentFreq(int word_id, int delta);
+
+    void CompactIfChurned();
+
+    // Marks the document removed in the sealed segment holding it, false if no sealed segment holds it
+    bool MarkRemovedInSealedSegment(int document_id);
+
+    // Seals the mutable segment once it is full
+    void SealIfFull();
+
+    // Installs a finished merge and starts the next one the policy asks for, waiting for merges if wait is set
+    void RunMerges(bool wait);
+
+    void StartMerge(size_t first, size_t count);
+
+    void InstallMerge();
+
+    // Ids of the query metrics in the process registry. Searches time their stages one after another:
+    // parsing, looking up posting lists, scoring, selecting the top documents and building the result,
+    // cache lookups and insertions included. Pruned evaluation selects while scoring, so its top-k time is in scoring.
+    // Batches count every query and time one parse per distinct query string, then the stages of every distinct query.
+    struct QueryMetrics {
+        size_t parse;
+        size_t posting_fetch;
+        size_t scoring;
+        size_t top_k;
+        size_t result_build;
+        size_t queries;
+        // Postings in the lists of plus words scored exhaustively
+        size_t postings;
+    };
+
+    static const QueryMetrics& GetQueryMetrics();
+
+    // Starts a new generation of cached results, called after every change of the documents
+    void InvalidateResults();
+
+    // Parsed queries are sorted and deduplicated, so queries differing only in word order share a key
+    static std::string MakeResultCacheKey(const Query& query, DocumentStatus status, size_t max_count);
+
+    // Only documents ranked after `after` are returned, all of them if it is absent
     template<typename Predicate>
-    std::vector<Document> FindAllDocuments(std::execution::sequenced_policy, const Query& query, Predicate predicate) const;
+    std::vector<Document> FindAllDocuments(std::execution::sequenced_policy, const Query& query, Predicate predicate,
+                                           size_t max_count, const std::optional<Document>& after = std::nullopt) const;
 
+    // Half-open interval of document ids [first_id, last_id)
+    struct DocumentRange {
+        int64_t first_id;
+        int64_t last_id;
+    };
+
+    static constexpr DocumentRange ALL_DOCUMENTS = {0, static_cast<int64_t>(std::numeric_limits<int>::max()) + 1};
+
+    // A plain DocumentStatus is tested against the bitmap of the status, any other predicate is called
+    // with the data of the document. Documents missing from phrase_documents are rejected unless it is null.
     template<typename Predicate>
-    std::vector<Document> FindAllDocuments(std::execution::parallel_policy, const Query& query, Predicate predicate) const;
+    bool IsAccepted(const Predicate& predicate, const std::vector<int>* phrase_documents, int document_id) const;
+
+    static std::vector<DocumentRange> SplitIntoDocumentRanges(const std::vector<const PostingList*>& postings, size_t max_range_count);
+
+    // Adds the best documents of one segment within the range to top_documents, the documents already there
+    // set the threshold from the start
+    template<typename Predicate>
+    void FindTopDocumentsPruned(const Query& query, Predicate predicate, const std::vector<int>* phrase_documents,
+                                const SegmentView& segment, DocumentRange range, TopDocuments& top_documents) const;
+
+    template<typename Predicate>
+    std::vector<Document> FindAllDocuments(std::execution::parallel_policy, const Query& query, Predicate predicate,
+                                           size_t max_count, const std::optional<Document>& after = std::nullopt) const;
 
 };
 
 template<typename TypeStop>
 SearchServer::SearchServer(const TypeStop& stopwords)
         : stop_words_(SetStopWords(stopwords))   {
+    // Query metrics take their names before LogDuration labels can use up the registry
+    GetQueryMetrics();
     for (const std::string& word : stop_words_) {
         if (!IsValidWord(word)) {
             throw std::invalid_argument("Incorrect symbol in stop words"s);
@@ -121,35 +472,51 @@ SearchServer::SearchServer(const TypeStop& stopwords)
 }
 
 template <typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw_query, DocumentPredicate document_predicate) const {
-    return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+std::vector<Document> SearchServer::FindTopDocuments(const std::string_view& raw_query, DocumentPredicate document_predicate,
+                                                     size_t max_count) const {
+    return FindTopDocuments(std::execution::seq, raw_query, document_predicate, max_count);
 }
 
 template <typename DocumentPredicate, class Execution>
-std::vector<Document> SearchServer::FindTopDocuments(Execution&& policy, const std::string_view& raw_query, DocumentPredicate document_predicate) const {
-    const Query query = ParseQuery(raw_query);
-    auto matched_documents = FindAllDocuments(policy, query, document_predicate);
-    sort(policy, matched_documents.begin(), matched_documents.end(),
-         [](const Document& lhs, const Document& rhs) {
-             if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
-                 return lhs.rating > rhs.rating;
-             } else {
-                 return lhs.relevance > rhs.relevance;
-             }
-         });
-    if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-        matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+std::vector<Document> SearchServer::FindTopDocuments(Execution&& policy, const std::string_view& raw_query, DocumentPredicate document_predicate,
+                                                     size_t max_count) const {
+    const QueryMetrics& metrics = GetQueryMetrics();
+    GetMetrics().Add(metrics.queries);
+    Query query;
+    {
+        ScopedTimer timer(metrics.parse);
+        query = ParseQuery(raw_query);
     }
-
-    return matched_documents;
+    // Documents come back already cut to max_count and ordered by IsMoreRelevant
+    return FindAllDocuments(policy, query, document_predicate, max_count);
 }
 
 template <class Execution>
-std::vector<Document> SearchServer::FindTopDocuments(Execution&& policy, const std::string_view& raw_query, DocumentStatus status) const {
-    auto lambda = [status](int document_id, DocumentStatus status_lambda, int rating) {
-        return status_lambda == status;
-    };
-    return  FindTopDocuments(policy, raw_query, lambda);
+std::vector<Document> SearchServer::FindTopDocuments(Execution&& policy, const std::string_view& raw_query, DocumentStatus status,
+                                                     size_t max_count) const {
+    // The status itself is passed on as the predicate, documents of other statuses are skipped by one bit test
+    const QueryMetrics& metrics = GetQueryMetrics();
+    GetMetrics().Add(metrics.queries);
+    Query query;
+    {
+        ScopedTimer timer(metrics.parse);
+        query = ParseQuery(raw_query);
+    }
+    if (!result_cache_) {
+        return FindAllDocuments(policy, query, status, max_count);
+    }
+    std::string key;
+    {
+        ScopedTimer timer(metrics.result_build);
+        key = MakeResultCacheKey(query, status, max_count);
+        if (std::optional<std::vector<Document>> documents = result_cache_->Find(key, result_generation_)) {
+            return std::move(*documents);
+        }
+    }
+    std::vector<Document> documents = FindAllDocuments(policy, query, status, max_count);
+    ScopedTimer timer(metrics.result_build);
+    result_cache_->Insert(key, documents, result_generation_);
+    return documents;
 }
 
 template <class Execution>
@@ -157,98 +524,366 @@ std::vector<Document> SearchServer::FindTopDocuments(Execution&& policy, const s
     return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
 }
 
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocumentsAfter(const std::string_view& raw_query, DocumentPredicate document_predicate,
+                                                          const std::optional<Document>& after, size_t page_size) const {
+    return FindTopDocumentsAfter(std::execution::seq, raw_query, document_predicate, after, page_size);
+}
+
+template <typename DocumentPredicate, class Execution>
+std::vector<Document> SearchServer::FindTopDocumentsAfter(Execution&& policy, const std::string_view& raw_query,
+                                                          DocumentPredicate document_predicate,
+                                                          const std::optional<Document>& after, size_t page_size) const {
+    const QueryMetrics& metrics = GetQueryMetrics();
+    GetMetrics().Add(metrics.queries);
+    Query query;
+    {
+        ScopedTimer timer(metrics.parse);
+        query = ParseQuery(raw_query);
+    }
+    return FindAllDocuments(policy, query, document_predicate, page_size, after);
+}
+
 template<typename Predicate>
-std::vector<Document> SearchServer::FindAllDocuments(std::execution::sequenced_policy, const Query& query, Predicate predicate) const {
-    std::map<int, double> document_to_relevance;
-    for (const std::string_view& word : query.plus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+std::vector<Document> SearchServer::FindAllDocuments(std::execution::sequenced_policy, const Query& query, Predicate predicate,
+                                                     size_t max_count, const std::optional<Document>& after) const {
+    const QueryMetrics& metrics = GetQueryMetrics();
+    ScopedTimer timer(metrics.posting_fetch);
+    const std::vector<SegmentView> segments = GetSegmentViews();
+    const std::optional<std::vector<int>> phrase_documents = FindPhraseDocuments(query);
+    const std::vector<int>* phrase_filter = phrase_documents ? &*phrase_documents : nullptr;
+    if (query_evaluation_ == QueryEvaluation::PRUNED) {
+        timer.Switch(metrics.scoring);
+        TopDocuments top_documents(max_count, after);
+        for (const SegmentView& segment : segments) {
+            FindTopDocumentsPruned(query, predicate, phrase_filter, segment, ALL_DOCUMENTS, top_documents);
+        }
+        timer.Switch(metrics.result_build);
+        return top_documents.Extract();
+    }
+    // Lists are looked up first and scored in the same order, word by word and segment by segment
+    struct SegmentPostings {
+        const PostingList* postings;
+        const SegmentView* segment;
+        double inverse_document_freq;
+    };
+    std::vector<SegmentPostings> plus_postings;
+    std::vector<SegmentPostings> minus_postings;
+    size_t posting_count = 0;
+    for (const QueryTerm& term : GetPlusTerms(query)) {
+        for (const SegmentView& segment : segments) {
+            if (const PostingList* postings = segment.segment->GetPostings(term.word_id)) {
+                plus_postings.push_back({postings, &segment, term.inverse_document_freq});
+                posting_count += postings->size();
+            }
+        }
+    }
+    for (const int word_id : query.minus_word_ids) {
+        if (GetDocumentFreq(word_id) == 0) {
             continue;
         }
-        const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-        for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-            const auto documentdata = documents_.at(document_id);
-            if (predicate(document_id, documentdata.status, documentdata.rating)) {
-                document_to_relevance[document_id] += term_freq * inverse_document_freq;
+        for (const SegmentView& segment : segments) {
+            if (const PostingList* postings = segment.segment->GetPostings(word_id)) {
+                minus_postings.push_back({postings, &segment, 0.0});
+            }
+        }
+    }
+    GetMetrics().Add(metrics.postings, posting_count);
+
+    // A document has postings in one segment only, the postings of removed documents are skipped
+    timer.Switch(metrics.scoring);
+    ScratchAccumulator scratch;
+    RelevanceAccumulator& document_to_relevance = scratch.Get();
+    for (const SegmentPostings& list : plus_postings) {
+        list.postings->ForEach(list.segment->segment->GetDocumentLengths(), [&](const Posting& posting) {
+            if (!list.segment->IsRemoved(posting.document_id) && IsAccepted(predicate, phrase_filter, posting.document_id)) {
+                document_to_relevance.Add(posting.document_id, posting.term_freq * list.inverse_document_freq);
+            }
+        });
+    }
+    for (const SegmentPostings& list : minus_postings) {
+        list.postings->ForEach(list.segment->segment->GetDocumentLengths(), [&](const Posting& posting) {
+            if (!list.segment->IsRemoved(posting.document_id)) {
+                document_to_relevance.Exclude(posting.document_id);
             }
+        });
+    }
+
+    timer.Switch(metrics.top_k);
+    TopDocuments top_documents(max_count, after);
+    document_to_relevance.ForEach([&](int document_id, double relevance) {
+        if (top_documents.CanKeep(relevance)) {
+            top_documents.Add({document_id, relevance, documents_.at(document_id).rating});
+        }
+    });
+    timer.Switch(metrics.result_build);
+    return top_documents.Extract();
+}
+
+template<typename Predicate>
+void SearchServer::FindTopDocumentsPruned(const Query& query, Predicate predicate, const std::vector<int>* phrase_documents,
+                                          const SegmentView& segment, DocumentRange range, TopDocuments& top_documents) const {
+    if (top_documents.GetMaxCount() == 0) {
+        return;
+    }
+    struct TermCursor {
+        PostingCursor postings;
+        double inverse_document_freq;
+        double max_score;
+        size_t query_index;
+    };
+
+    const DocumentLengths& lengths = segment.segment->GetDocumentLengths();
+    std::vector<TermCursor> cursors;
+    for (const QueryTerm& term : GetPlusTerms(query)) {
+        const PostingList* postings = segment.segment->GetPostings(term.word_id);
+        if (postings == nullptr) {
+            continue;
+        }
+        cursors.push_back({PostingCursor(*postings, lengths, range.first_id, range.last_id), term.inverse_document_freq,
+                           postings->GetMaxTermFreq() * term.inverse_document_freq, term.index});
+    }
+    // Candidates come in ascending order of ids, so minus words are checked by cursors moving forward too
+    std::vector<PostingCursor> minus_cursors;
+    for (const int word_id : query.minus_word_ids) {
+        const PostingList* postings = GetDocumentFreq(word_id) == 0 ? nullptr : segment.segment->GetPostings(word_id);
+        if (postings != nullptr) {
+            minus_cursors.emplace_back(*postings, lengths, range.first_id, range.last_id);
+        }
+    }
+
+    // Cursors are ordered by score upper bound, bound_sums[i] is the total bound of the first i cursors.
+    // Cursors below first_essential together cannot lift a document above the threshold,
+    // so candidates are taken from the essential ones only.
+    std::sort(cursors.begin(), cursors.end(), [](const TermCursor& lhs, const TermCursor& rhs) {
+        return lhs.max_score < rhs.max_score;
+    });
+    std::vector<double> bound_sums(cursors.size() + 1, 0.0);
+    for (size_t i = 0; i < cursors.size(); ++i) {
+        bound_sums[i + 1] = bound_sums[i] + cursors[i].max_score;
+    }
+
+    size_t first_essential = 0;
+    double threshold = 0.0;
+    auto raise_threshold = [&]() {
+        threshold = top_documents.GetWorst().relevance;
+        while (first_essential < cursors.size() && bound_sums[first_essential + 1] < threshold - EPSILON) {
+            ++first_essential;
         }
+    };
+    if (top_documents.IsFull()) {
+        raise_threshold();
     }
+    // Term scores are summed in query order afterwards to get exactly the exhaustive relevance,
+    // adding the zero of an unmatched term changes nothing. Words of a prefix add up in one score.
+    std::vector<double> term_scores(query.plus_word_ids.size() + query.plus_prefix_word_ids.size());
+
+    while (first_essential < cursors.size()) {
+        int candidate = std::numeric_limits<int>::max();
+        bool has_candidate = false;
+        for (size_t i = first_essential; i < cursors.size(); ++i) {
+            const PostingCursor& postings = cursors[i].postings;
+            if (!postings.IsEnd() && postings.Get().document_id <= candidate) {
+                candidate = postings.Get().document_id;
+                has_candidate = true;
+            }
+        }
+        if (!has_candidate) {
+            break;
+        }
 
-    for (const std::string_view& word : query.minus_words) {
-        if (word_to_document_freqs_.count(word) == 0) {
+        // Postings of a removed document are passed over like those of a rejected one
+        bool accepted = !segment.IsRemoved(candidate) && IsAccepted(predicate, phrase_documents, candidate);
+        std::fill(term_scores.begin(), term_scores.end(), 0.0);
+        double score = 0.0;
+        for (size_t i = first_essential; i < cursors.size(); ++i) {
+            TermCursor& cursor = cursors[i];
+            if (!cursor.postings.IsEnd() && cursor.postings.Get().document_id == candidate) {
+                const double term_score = cursor.postings.Get().term_freq * cursor.inverse_document_freq;
+                term_scores[cursor.query_index] += term_score;
+                score += term_score;
+                cursor.postings.Next();
+            }
+        }
+        for (size_t i = first_essential; accepted && i > 0; --i) {
+            if (top_documents.IsFull() && score + bound_sums[i] < threshold - EPSILON) {
+                accepted = false;
+                break;
+            }
+            TermCursor& cursor = cursors[i - 1];
+            cursor.postings.SeekTo(candidate);
+            if (!cursor.postings.IsEnd() && cursor.postings.Get().document_id == candidate) {
+                const double term_score = cursor.postings.Get().term_freq * cursor.inverse_document_freq;
+                term_scores[cursor.query_index] += term_score;
+                score += term_score;
+            }
+        }
+        if (!accepted || (top_documents.IsFull() && score < threshold - EPSILON)) {
             continue;
         }
-        for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-            document_to_relevance.erase(document_id);
+        if (std::any_of(minus_cursors.begin(), minus_cursors.end(),
+                        [candidate](PostingCursor& postings) {
+                            postings.SeekTo(candidate);
+                            return !postings.IsEnd() && postings.Get().document_id == candidate;
+                        })) {
+            continue;
+        }
+
+        const double relevance = std::accumulate(term_scores.begin(), term_scores.end(), 0.0);
+        top_documents.Add({candidate, relevance, documents_.at(candidate).rating});
+        if (top_documents.IsFull()) {
+            raise_threshold();
         }
     }
+}
 
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : document_to_relevance) {
-        matched_documents.push_back(
-                {document_id, relevance, documents_.at(document_id).rating});
+template<typename Predicate>
+bool SearchServer::IsAccepted(const Predicate& predicate, const std::vector<int>* phrase_documents, int document_id) const {
+    if (phrase_documents != nullptr && !std::binary_search(phrase_documents->begin(), phrase_documents->end(), document_id)) {
+        return false;
+    }
+    if constexpr (std::is_same_v<Predicate, DocumentStatus>) {
+        return status_documents_[static_cast<size_t>(predicate)].Contains(document_id);
+    } else {
+        const DocumentData& documentdata = documents_.at(document_id);
+        return predicate(document_id, documentdata.status, documentdata.rating);
     }
-    return matched_documents;
 }
 
 template<typename Predicate>
-std::vector<Document> SearchServer::FindAllDocuments(std::execution::parallel_policy, const Query& query, Predicate predicate) const {
-    ConcurrentMap<int, double> document_to_relevance(100);
+std::vector<Document> SearchServer::FindAllDocuments(std::execution::parallel_policy, const Query& query, Predicate predicate,
+                                                     size_t max_count, const std::optional<Document>& after) const {
+    const QueryMetrics& metrics = GetQueryMetrics();
+    ScopedTimer timer(metrics.posting_fetch);
+    const std::vector<SegmentView> segments = GetSegmentViews();
+    const std::optional<std::vector<int>> phrase_documents = FindPhraseDocuments(query);
+    const std::vector<int>* phrase_filter = phrase_documents ? &*phrase_documents : nullptr;
+    const std::vector<QueryTerm> plus_terms = GetPlusTerms(query);
+    std::vector<const PostingList*> plus_postings;
+    size_t posting_count = 0;
+    for (const QueryTerm& term : plus_terms) {
+        for (const SegmentView& segment : segments) {
+            if (const PostingList* postings = segment.segment->GetPostings(term.word_id)) {
+                plus_postings.push_back(postings);
+                posting_count += postings->size();
+            }
+        }
+    }
+    if (query_evaluation_ == QueryEvaluation::EXHAUSTIVE) {
+        GetMetrics().Add(metrics.postings, posting_count);
+    }
 
+    // Posting lists are cut into document id ranges holding about the same number of postings.
+    // Every range is scored by one task into its own accumulator and top, nothing is shared until the merge.
+    const std::vector<DocumentRange> ranges =
+            SplitIntoDocumentRanges(plus_postings, std::max(1u, std::thread::hardware_concurrency()) * 4);
+    timer.Switch(metrics.scoring);
+    std::vector<TopDocuments> partial_tops(ranges.size(), TopDocuments(max_count, after));
+    std::vector<size_t> range_indexes(ranges.size());
+    std::iota(range_indexes.begin(), range_indexes.end(), 0);
     for_each(std::execution::par,
-             query.plus_words.begin(),
-             query.plus_words.end(),
-             [&] (const std::string_view word) {
-                 const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-                 for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-                     const auto& documentdata = documents_.at(document_id);
-                     if (predicate(document_id, documentdata.status, documentdata.rating)) {
-                         document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
+             range_indexes.begin(),
+             range_indexes.end(),
+             [&](size_t range_index) {
+                 const DocumentRange range = ranges[range_index];
+                 if (query_evaluation_ == QueryEvaluation::PRUNED) {
+                     for (const SegmentView& segment : segments) {
+                         FindTopDocumentsPruned(query, predicate, phrase_filter, segment, range, partial_tops[range_index]);
                      }
+                     return;
                  }
-             });
-
-    for_each(std::execution::par,
-             query.minus_words.begin(),
-             query.minus_words.end(),
-             [&] (const std::string_view word) {
-                 if (word_to_document_freqs_.count(word) > 0) {
-                     for (const auto [document_id, _]: word_to_document_freqs_.at(word)) {
-                         document_to_relevance.Erase(document_id);
+                 ScratchAccumulator scratch;
+                 RelevanceAccumulator& document_to_relevance = scratch.Get();
+                 for (const QueryTerm& term : plus_terms) {
+                     for (const SegmentView& segment : segments) {
+                         const PostingList* postings = segment.segment->GetPostings(term.word_id);
+                         if (postings == nullptr) {
+                             continue;
+                         }
+                         const DocumentLengths& lengths = segment.segment->GetDocumentLengths();
+                         postings->ForEach(lengths, range.first_id, range.last_id, [&](const Posting& posting) {
+                             if (!segment.IsRemoved(posting.document_id) && IsAccepted(predicate, phrase_filter, posting.document_id)) {
+                                 document_to_relevance.Add(posting.document_id, posting.term_freq * term.inverse_document_freq);
+                             }
+                         });
                      }
                  }
+                 for (const int word_id : query.minus_word_ids) {
+                     if (GetDocumentFreq(word_id) == 0) {
+                         continue;
+                     }
+                     for (const SegmentView& segment : segments) {
+                         const PostingList* postings = segment.segment->GetPostings(word_id);
+                         if (postings == nullptr) {
+                             continue;
+                         }
+                         const DocumentLengths& lengths = segment.segment->GetDocumentLengths();
+                         postings->ForEach(lengths, range.first_id, range.last_id, [&](const Posting& posting) {
+                             if (!segment.IsRemoved(posting.document_id)) {
+                                 document_to_relevance.Exclude(posting.document_id);
+                             }
+                         });
+                     }
+                 }
+                 document_to_relevance.ForEach([&](int document_id, double relevance) {
+                     if (partial_tops[range_index].CanKeep(relevance)) {
+                         partial_tops[range_index].Add({document_id, relevance, documents_.at(document_id).rating});
+                     }
+                 });
              });
 
-    std::map<int, double> ordinaryMap = document_to_relevance.BuildOrdinaryMap();
-    std::vector<Document> matched_documents;
-    for (const auto [document_id, relevance] : ordinaryMap) {
-        matched_documents.push_back(
-                {document_id, relevance, documents_.at(document_id).rating});
+    timer.Switch(metrics.top_k);
+    TopDocuments top_documents(max_count, after);
+    for (const TopDocuments& partial_top : partial_tops) {
+        top_documents.Merge(partial_top);
     }
-    return matched_documents;
+    timer.Switch(metrics.result_build);
+    return top_documents.Extract();
 }
 
 template<class Execution>
 void SearchServer::RemoveDocument(Execution&& policy, int document_id) {
-    if (!documents_ids_.count(document_id)) {
-        return;
+    if (EraseDocument(policy, document_id)) {
+        RunMerges(false);
+        CompactIfChurned();
+        InvalidateResults();
+    }
+}
+
+template<class Execution>
+bool SearchServer::EraseDocument(Execution&& policy, int document_id) {
+    if (!documents_.count(document_id)) {
+        return false;
+    }
+    const std::vector<int> word_ids = GetDocumentWordIds(document_id);
+    for (const int word_id : word_ids) {
+        AddDocumentFreq(word_id, -1);
+    }
+    // Postings of the mutable segment are erased, every word id owns its own posting list,
+    // so the lists can be edited independently. A sealed segment only remembers the document is removed.
+    if (mutable_segment_.HasDocument(document_id)) {
+        mutable_segment_.RemoveDocument(policy, document_id, word_ids);
+    } else {
+        MarkRemovedInSealedSegment(document_id);
+    }
+    forward_index_.Remove(document_id);
+    if (position_index_) {
+        position_index_->Remove(document_id);
+    }
+    status_documents_[static_cast<size_t>(documents_.at(document_id).status)].Erase(document_id);
+    documents_.Erase(document_id);
+    return true;
+}
+
+template <typename Action>
+void SearchServer::VisitDocumentWords(int document_id, Action action) const {
+    if (forward_index_.Contains(document_id)) {
+        const auto [first, last] = forward_index_.GetWords(document_id);
+        action(first, last);
+    } else if (snapshot_) {
+        const auto [first, last] = snapshot_->GetDocumentWords(document_id);
+        action(first, last);
     }
-    documents_ids_.erase(document_id);
-    documents_.erase(document_id);
-    auto& toErase = words_freq_.at(document_id);
-    std::vector<const std::string*> words(toErase.size());
-    std::transform(toErase.begin(),
-                   toErase.end(),
-                   words.begin(),
-                   [](const auto& x) {
-                       return &x.first;
-                   });
-    std::for_each(policy,
-                  words.begin(),
-                  words.end(),
-                  [&](auto key) {
-                      word_to_document_freqs_.at(*key).erase(document_id);
-                  });
-    words_freq_.erase(document_id);
 }
 
 template <typename Key, typename Value>
@@ -0,0 +1,304 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// First of the (id, value) pairs sorted by id whose id is not less than id
+template <typename Pairs>
+auto LowerBoundId(Pairs& pairs, int id) {
+    return std::lower_bound(pairs.begin(), pairs.end(), id, [](const auto& pair, int key) {
+        return pair.first < key;
+    });
+}
+
+// Pages shared between copies of a container. Copying copies the page pointers only, and a copy about to change
+// a page another copy holds gets its own copy of the page first, so every version of a large container costs
+// the pages it changed. A copy must not be changed while it is being copied. Other copies may be destroyed
+// concurrently with changes: a page found held only here is changed in place after an acquire fence,
+// so the reads of the copy that released it happen before the change.
+// Pages are kept by index in a sorted directory, the dense indexes 0, 1, 2... are found without a search.
+template <typename Page>
+class SharedPages {
+public:
+    // nullptr if the page was never created
+    const Page* Find(size_t index) const {
+        const size_t position = FindPosition(index);
+        if (position == directory_.size() || directory_[position].index != index) {
+            return nullptr;
+        }
+        return directory_[position].page.get();
+    }
+
+    // Creates the page if there is none, copies it if another container holds it
+    Page& GetMutable(size_t index) {
+        const size_t position = FindPosition(index);
+        if (position == directory_.size() || directory_[position].index != index) {
+            directory_.insert(directory_.begin() + static_cast<std::ptrdiff_t>(position),
+                              {index, std::make_shared<Page>()});
+        }
+        return GetMutablePage(position);
+    }
+
+    // Pages in the order of their indexes, by position in the directory
+    size_t GetPageCount() const {
+        return directory_.size();
+    }
+
+    const Page& GetPage(size_t position) const {
+        return *directory_[position].page;
+    }
+
+    Page& GetMutablePage(size_t position) {
+        std::shared_ptr<Page>& page = directory_[position].page;
+        if (page.use_count() > 1) {
+            page = std::make_shared<Page>(*page);
+        } else {
+            // use_count() is a relaxed load, the fence pairs it with the release of the last other owner
+            std::atomic_thread_fence(std::memory_order_acquire);
+        }
+        return *page;
+    }
+
+    // Bytes of the directory and of every page, page_bytes(page) counting the heap memory a page owns
+    template <typename PageBytes>
+    size_t GetMemoryBytes(PageBytes page_bytes) const {
+        size_t bytes = directory_.capacity() * sizeof(Entry);
+        for (const Entry& entry : directory_) {
+            bytes += sizeof(Page) + page_bytes(*entry.page);
+        }
+        return bytes;
+    }
+
+private:
+    struct Entry {
+        size_t index;
+        std::shared_ptr<Page> page;
+    };
+
+    std::vector<Entry> directory_;
+
+    size_t FindPosition(size_t index) const {
+        if (index < directory_.size() && directory_[index].index == index) {
+            return index;
+        }
+        return static_cast<size_t>(std::lower_bound(directory_.begin(), directory_.end(), index,
+                                                     [](const Entry& entry, size_t value) {
+                                                         return entry.index < value;
+                                                     })
+                                   - directory_.begin());
+    }
+};
+
+// Vector kept in shared pages of 2^PAGE_BITS values, see SharedPages
+template <typename T, int PAGE_BITS = 10>
+class SharedVector {
+public:
+    static constexpr size_t PAGE_SIZE = size_t{1} << PAGE_BITS;
+
+    size_t size() const {
+        return size_;
+    }
+
+    const T& operator[](size_t index) const {
+        return (*pages_.Find(index >> PAGE_BITS))[index & (PAGE_SIZE - 1)];
+    }
+
+    T& GetMutable(size_t index) {
+        return pages_.GetMutable(index >> PAGE_BITS)[index & (PAGE_SIZE - 1)];
+    }
+
+    void push_back(const T& value) {
+        GetMutable(size_) = value;
+        ++size_;
+    }
+
+    size_t GetMemoryBytes() const {
+        return pages_.GetMemoryBytes([](const Page&) {
+            return size_t{0};
+        });
+    }
+
+private:
+    using Page = std::array<T, PAGE_SIZE>;
+
+    SharedPages<Page> pages_;
+    size_t size_ = 0;
+};
+
+// Map from non-negative ids to values, ordered by id and kept in shared pages, see SharedPages.
+// A page holds the values of 2^PAGE_BITS consecutive ids as an array sorted by id.
+template <typename T, int PAGE_BITS = 8>
+class SharedIdMap {
+public:
+    using value_type = std::pair<int, T>;
+
+private:
+    using Page = std::vector<value_type>;
+
+public:
+    // Iterates over the values, or over the ids only if IDS is set
+    template <bool IDS>
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::conditional_t<IDS, int, SharedIdMap::value_type>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const value_type*;
+        using reference = const value_type&;
+
+        Iterator() = default;
+
+        reference operator*() const {
+            const Value& value = pages_->GetPage(position_)[slot_];
+            if constexpr (IDS) {
+                return value.first;
+            } else {
+                return value;
+            }
+        }
+
+        pointer operator->() const {
+            return &**this;
+        }
+
+        Iterator& operator++() {
+            ++slot_;
+            SkipPageEnds();
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return position_ == other.position_ && slot_ == other.slot_;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        friend class SharedIdMap;
+        using Value = SharedIdMap::value_type;
+
+        const SharedPages<Page>* pages_ = nullptr;
+        size_t position_ = 0;
+        size_t slot_ = 0;
+
+        Iterator(const SharedPages<Page>* pages, size_t position)
+                : pages_(pages), position_(position) {
+            SkipPageEnds();
+        }
+
+        void SkipPageEnds() {
+            while (position_ < pages_->GetPageCount() && slot_ == pages_->GetPage(position_).size()) {
+                ++position_;
+                slot_ = 0;
+            }
+        }
+    };
+
+    using const_iterator = Iterator<false>;
+    using id_iterator = Iterator<true>;
+
+    size_t size() const {
+        return size_;
+    }
+
+    size_t count(int id) const {
+        return Find(id) != nullptr ? 1 : 0;
+    }
+
+    // nullptr if there is no such id
+    const T* Find(int id) const {
+        const Page* page = pages_.Find(GetPageIndex(id));
+        if (page == nullptr) {
+            return nullptr;
+        }
+        const auto it = LowerBoundId(*page, id);
+        return it != page->end() && it->first == id ? &it->second : nullptr;
+    }
+
+    // Throws std::out_of_range if there is no such id
+    const T& at(int id) const {
+        const T* value = Find(id);
+        if (value == nullptr) {
+            throw std::out_of_range("No such id");
+        }
+        return *value;
+    }
+
+    // Adds the value or replaces the value the id has
+    void Insert(int id, T value) {
+        Page& page = pages_.GetMutable(GetPageIndex(id));
+        const auto it = LowerBoundId(page, id);
+        if (it != page.end() && it->first == id) {
+            it->second = std::move(value);
+            return;
+        }
+        page.emplace(it, id, std::move(value));
+        ++size_;
+    }
+
+    // False if there is no such id
+    bool Erase(int id) {
+        if (Find(id) == nullptr) {
+            return false;
+        }
+        Page& page = pages_.GetMutable(GetPageIndex(id));
+        page.erase(LowerBoundId(page, id));
+        --size_;
+        return true;
+    }
+
+    // Calls action(id, value) for every value in the order of ids, pages held by other maps are copied
+    template <typename Action>
+    void ForEachMutable(Action action) {
+        for (size_t position = 0; position < pages_.GetPageCount(); ++position) {
+            for (auto& [id, value] : pages_.GetMutablePage(position)) {
+                action(id, value);
+            }
+        }
+    }
+
+    const_iterator begin() const {
+        return const_iterator(&pages_, 0);
+    }
+
+    const_iterator end() const {
+        return const_iterator(&pages_, pages_.GetPageCount());
+    }
+
+    id_iterator BeginIds() const {
+        return id_iterator(&pages_, 0);
+    }
+
+    id_iterator EndIds() const {
+        return id_iterator(&pages_, pages_.GetPageCount());
+    }
+
+    size_t GetMemoryBytes() const {
+        return pages_.GetMemoryBytes([](const Page& page) {
+            return page.capacity() * sizeof(value_type);
+        });
+    }
+
+private:
+    SharedPages<Page> pages_;
+    size_t size_ = 0;
+
+    static size_t GetPageIndex(int id) {
+        return static_cast<size_t>(id) >> PAGE_BITS;
+    }
+};
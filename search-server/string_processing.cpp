@@ -1,14 +1,171 @@
 #include "string_processing.h"
+#include <cstdint>
 
-std::vector<std::string_view> SplitIntoWords(const std::string_view& text) {
-    std::vector<std::string_view> words;
-    int64_t pos = text.find_first_not_of(" ");
-    const int64_t pos_end = text.npos;
-    while (pos != pos_end) {
-        int64_t space = text.find(' ', pos);
-        words.push_back(space == pos_end ? text.substr(pos) : text.substr(pos, space - pos));
-        pos = text.find_first_not_of(" ", space);
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SEARCH_SERVER_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(SEARCH_SERVER_SSE2) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SEARCH_SERVER_AVX2
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+
+bool IsControl(char c) {
+    return static_cast<unsigned char>(c) < ' ';
+}
+
+int CountTrailingZeros(uint64_t mask) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, mask);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(mask);
+#endif
+}
+
+// Turns space positions into word spans. Text comes in blocks described by bit masks,
+// a word may continue from one block into the next.
+class WordCollector {
+public:
+    WordCollector(std::string_view text, std::vector<std::string_view>& words)
+            : text_(text)
+            , words_(words) {
     }
 
+    // Bit i of the masks describes text[base + i], block_size is at most 64
+    void AddBlock(size_t base, size_t block_size, uint64_t spaces) {
+        const uint64_t block_bits = block_size == 64 ? ~uint64_t{0} : (uint64_t{1} << block_size) - 1;
+        const uint64_t non_spaces = ~spaces & block_bits;
+        size_t pos = 0;
+        while (pos < block_size) {
+            const uint64_t next = (in_word_ ? spaces : non_spaces) >> pos;
+            if (next == 0) {
+                break;
+            }
+            pos += CountTrailingZeros(next);
+            if (in_word_) {
+                words_.push_back(text_.substr(word_start_, base + pos - word_start_));
+            } else {
+                word_start_ = base + pos;
+            }
+            in_word_ = !in_word_;
+        }
+    }
+
+    // Scalar path for the text tail starting at first, returns false on a control character
+    bool AddTail(size_t first) {
+        bool is_valid = true;
+        for (size_t pos = first; pos < text_.size(); ++pos) {
+            const char c = text_[pos];
+            is_valid &= !IsControl(c);
+            if ((c == ' ') == in_word_) {
+                if (in_word_) {
+                    words_.push_back(text_.substr(word_start_, pos - word_start_));
+                } else {
+                    word_start_ = pos;
+                }
+                in_word_ = !in_word_;
+            }
+        }
+        if (in_word_) {
+            words_.push_back(text_.substr(word_start_));
+            in_word_ = false;
+        }
+        return is_valid;
+    }
+
+private:
+    std::string_view text_;
+    std::vector<std::string_view>& words_;
+    size_t word_start_ = 0;
+    bool in_word_ = false;
+};
+
+#ifndef SEARCH_SERVER_SSE2
+// Without SIMD the whole text is the tail
+bool SplitScalar(std::string_view text, std::vector<std::string_view>& words) {
+    return WordCollector(text, words).AddTail(0);
+}
+#endif
+
+#ifdef SEARCH_SERVER_SSE2
+// Handles one 16-byte block, returns the mask of control characters in it
+__m128i AddBlockSse2(WordCollector& collector, const char* data, size_t pos) {
+    const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+    const auto spaces = static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, _mm_set1_epi8(' '))));
+    collector.AddBlock(pos, 16, spaces);
+    // Unsigned c <= 31 is the same as min(c, 31) == c
+    return _mm_cmpeq_epi8(_mm_min_epu8(chunk, _mm_set1_epi8(' ' - 1)), chunk);
+}
+
+bool SplitSse2(std::string_view text, std::vector<std::string_view>& words) {
+    WordCollector collector(text, words);
+    __m128i controls = _mm_setzero_si128();
+    size_t pos = 0;
+    for (; pos + 16 <= text.size(); pos += 16) {
+        controls = _mm_or_si128(controls, AddBlockSse2(collector, text.data(), pos));
+    }
+    const bool is_tail_valid = collector.AddTail(pos);
+    return is_tail_valid && _mm_movemask_epi8(controls) == 0;
+}
+#endif
+
+#ifdef SEARCH_SERVER_AVX2
+__attribute__((target("avx2")))
+bool SplitAvx2(std::string_view text, std::vector<std::string_view>& words) {
+    WordCollector collector(text, words);
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i last_control = _mm256_set1_epi8(' ' - 1);
+    __m256i controls = _mm256_setzero_si256();
+    size_t pos = 0;
+    for (; pos + 32 <= text.size(); pos += 32) {
+        const __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(text.data() + pos));
+        controls = _mm256_or_si256(controls, _mm256_cmpeq_epi8(_mm256_min_epu8(chunk, last_control), chunk));
+        const auto spaces = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, space)));
+        collector.AddBlock(pos, 32, spaces);
+    }
+    // Short texts such as queries mostly end up here, a half block still goes through SSE2
+    __m128i tail_controls = _mm_setzero_si128();
+    if (pos + 16 <= text.size()) {
+        tail_controls = AddBlockSse2(collector, text.data(), pos);
+        pos += 16;
+    }
+    const bool is_tail_valid = collector.AddTail(pos);
+    return is_tail_valid && _mm256_testz_si256(controls, controls) && _mm_movemask_epi8(tail_controls) == 0;
+}
+#endif
+
+using SplitFunction = bool (*)(std::string_view, std::vector<std::string_view>&);
+
+// Picks the widest implementation the running CPU supports
+SplitFunction SelectSplitFunction() {
+#ifdef SEARCH_SERVER_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return SplitAvx2;
+    }
+#endif
+#ifdef SEARCH_SERVER_SSE2
+    return SplitSse2;
+#else
+    return SplitScalar;
+#endif
+}
+
+}  // namespace
+
+std::vector<std::string_view> SplitIntoWords(const std::string_view& text) {
+    std::vector<std::string_view> words;
+    SplitIntoValidWords(text, words);
     return words;
-}
\ No newline at end of file
+}
+
+bool SplitIntoValidWords(std::string_view text, std::vector<std::string_view>& words) {
+    static const SplitFunction split = SelectSplitFunction();
+    return split(text, words);
+}
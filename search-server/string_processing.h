@@ -1,13 +1,18 @@
 #pragma once
 #include <vector>
 #include <string>
+#include <string_view>
 #include <set>
 #include <algorithm>
 std::vector<std::string_view> SplitIntoWords(const std::string_view& text);
 
+// Splits text by spaces and checks it for control characters ('\0' to '\x1f') in the same pass.
+// Returns false if text contains a control character, words are still appended then.
+bool SplitIntoValidWords(std::string_view text, std::vector<std::string_view>& words);
+
 template<typename TypeStop>
 std::set<std::string, std::less<>> SetStopWords(const TypeStop& stopwords) {
     std::set<std::string, std::less<>> stop_words;
     stop_words.insert(stopwords.begin(), stopwords.end());
     return stop_words;
-}
\ No newline at end of file
+}
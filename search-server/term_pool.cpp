@@ -0,0 +1,73 @@
+#include "term_pool.h"
+#include <algorithm>
+#include <iterator>
+
+TermPool::TermPool(int first_id)
+        : first_id_(first_id),
+          texts_(std::make_shared<TextArena>()),
+          sealed_terms_(std::make_shared<const TermTrie>()) {
+}
+
+int TermPool::Find(std::string_view term) const {
+    const int id = sealed_terms_->Find(term);
+    if (id != -1) {
+        return id;
+    }
+    const auto it = recent_terms_.find(term);
+    return it == recent_terms_.end() ? -1 : it->second;
+}
+
+int TermPool::Add(std::string_view term) {
+    const int found_id = Find(term);
+    if (found_id != -1) {
+        return found_id;
+    }
+    const std::string_view stored = texts_->Store(term);
+    const int id = GetNextId();
+    terms_.push_back(stored);
+    recent_terms_.emplace(stored, id);
+    if (recent_terms_.size() >= std::max(MIN_RECENT_TERMS, sealed_terms_->size() / 8)) {
+        Seal();
+    }
+    return id;
+}
+
+std::string_view TermPool::Get(int id) const {
+    return terms_[id - first_id_];
+}
+
+void TermPool::FindPrefix(std::string_view prefix, std::vector<int>& ids) const {
+    const auto [first, last] = sealed_terms_->FindPrefix(prefix);
+    ids.insert(ids.end(), first, last);
+    for (auto it = recent_terms_.lower_bound(prefix);
+         it != recent_terms_.end() && it->first.substr(0, prefix.size()) == prefix; ++it) {
+        ids.push_back(it->second);
+    }
+}
+
+int TermPool::GetNextId() const {
+    return first_id_ + static_cast<int>(terms_.size());
+}
+
+void TermPool::Seal() {
+    if (recent_terms_.empty()) {
+        return;
+    }
+    // Terms of the trie come out sorted, so the two sorted runs are merged
+    const auto [first, last] = sealed_terms_->FindPrefix({});
+    std::vector<std::pair<std::string_view, int>> terms;
+    terms.reserve(terms_.size());
+    std::transform(first, last, std::back_inserter(terms), [this](int id) {
+        return std::pair{Get(id), id};
+    });
+    const auto middle = static_cast<std::ptrdiff_t>(terms.size());
+    terms.insert(terms.end(), recent_terms_.begin(), recent_terms_.end());
+    std::inplace_merge(terms.begin(), terms.begin() + middle, terms.end());
+    sealed_terms_ = std::make_shared<const TermTrie>(terms);
+    recent_terms_.clear();
+}
+
+size_t TermPool::GetMemoryBytes() const {
+    return texts_->GetCapacity() + terms_.GetMemoryBytes() + sealed_terms_->GetMemoryBytes() +
+           EstimateTreeBytes(recent_terms_);
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include "text_arena.h"
+#include "term_trie.h"
+#include "memory_stats.h"
+#include "shared_pages.h"
+#include <map>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Interning pool of terms: keeps the text of every distinct term once and numbers the terms densely.
+// Views returned by the pool stay valid while the pool lives, whatever happens to the texts they came from.
+// Copies of a pool share its append-only text storage, so views stay valid while any of the copies lives.
+// Terms are looked up in an immutable trie shared with copies. New terms wait in a small sorted map
+// until they make up an eighth of the trie, then the trie is rebuilt with them.
+class TermPool {
+public:
+    // The map of new terms is not sealed below this size
+    static constexpr size_t MIN_RECENT_TERMS = 1024;
+
+    // Ids are given out starting from first_id, lower ids may be used by another dictionary
+    explicit TermPool(int first_id = 0);
+
+    // Id of the term, -1 if the term was never added
+    int Find(std::string_view term) const;
+
+    // Id of the term, the term is copied into the pool on first addition
+    int Add(std::string_view term);
+
+    std::string_view Get(int id) const;
+
+    // Appends the ids of the terms starting with the prefix, in time of the prefix length and the number of terms found
+    void FindPrefix(std::string_view prefix, std::vector<int>& ids) const;
+
+    // Id the next new term will get
+    int GetNextId() const;
+
+    // Rebuilds the trie with the new terms
+    void Seal();
+
+    // Heap bytes of the pool, text storage and the trie shared with copies included
+    size_t GetMemoryBytes() const;
+
+private:
+    int first_id_;
+    std::shared_ptr<TextArena> texts_;
+    // Pages of terms are shared with copies
+    SharedVector<std::string_view> terms_;
+    std::shared_ptr<const TermTrie> sealed_terms_;
+    // Terms added after the trie was built
+    std::map<std::string_view, int, std::less<>> recent_terms_;
+};
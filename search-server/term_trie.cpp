@@ -0,0 +1,94 @@
+#include "term_trie.h"
+#include <algorithm>
+
+TermTrie::TermTrie()
+        : TermTrie(std::vector<std::pair<std::string_view, int>>{}) {
+}
+
+TermTrie::TermTrie(const std::vector<std::pair<std::string_view, int>>& terms) {
+    ids_.reserve(terms.size());
+    for (const auto& [term, id] : terms) {
+        ids_.push_back(id);
+    }
+    labels_.push_back(0);
+    first_ranks_.push_back(0);
+    // Levels are built one after another, every node of a level lists the ranks of its terms.
+    // Nodes are numbered in the order they are created, so the children of a node follow those of its left neighbour.
+    std::vector<std::pair<uint32_t, uint32_t>> level = {{0, static_cast<uint32_t>(terms.size())}};
+    std::vector<std::pair<uint32_t, uint32_t>> next_level;
+    for (size_t depth = 0; !level.empty(); ++depth) {
+        next_level.clear();
+        for (const auto& [first_rank, last_rank] : level) {
+            first_children_.push_back(static_cast<uint32_t>(labels_.size()));
+            uint32_t rank = first_rank;
+            // A term ending at this node sorts before the longer ones
+            if (rank < last_rank && terms[rank].first.size() == depth) {
+                ++rank;
+            }
+            while (rank < last_rank) {
+                const char byte = terms[rank].first[depth];
+                uint32_t end = rank + 1;
+                while (end < last_rank && terms[end].first[depth] == byte) {
+                    ++end;
+                }
+                labels_.push_back(static_cast<uint8_t>(byte));
+                first_ranks_.push_back(rank);
+                next_level.emplace_back(rank, end);
+                rank = end;
+            }
+        }
+        level.swap(next_level);
+    }
+    first_children_.push_back(static_cast<uint32_t>(labels_.size()));
+}
+
+int TermTrie::Find(std::string_view term) const {
+    NodeRange range;
+    if (!Descend(term, range) || range.first_rank == range.last_rank) {
+        return -1;
+    }
+    // The term ends here if the first term below the node is not below any of its children
+    const uint32_t first_child = first_children_[range.node];
+    const bool has_children = first_child != first_children_[range.node + 1];
+    if (has_children && first_ranks_[first_child] == range.first_rank) {
+        return -1;
+    }
+    return ids_[range.first_rank];
+}
+
+std::pair<const int*, const int*> TermTrie::FindPrefix(std::string_view prefix) const {
+    NodeRange range;
+    if (!Descend(prefix, range)) {
+        return {ids_.data(), ids_.data()};
+    }
+    return {ids_.data() + range.first_rank, ids_.data() + range.last_rank};
+}
+
+size_t TermTrie::size() const {
+    return ids_.size();
+}
+
+size_t TermTrie::GetMemoryBytes() const {
+    return EstimateVectorBytes(labels_) + EstimateVectorBytes(first_children_) + EstimateVectorBytes(first_ranks_) +
+           EstimateVectorBytes(ids_);
+}
+
+bool TermTrie::Descend(std::string_view text, NodeRange& range) const {
+    range = {0, 0, static_cast<uint32_t>(ids_.size())};
+    for (const char c : text) {
+        const auto first = labels_.begin() + first_children_[range.node];
+        const auto last = labels_.begin() + first_children_[range.node + 1];
+        const auto child = std::lower_bound(first, last, static_cast<uint8_t>(c));
+        if (child == last || *child != static_cast<uint8_t>(c)) {
+            return false;
+        }
+        const auto node = static_cast<uint32_t>(child - labels_.begin());
+        // The last child keeps the end of the ranks of its parent
+        if (child + 1 != last) {
+            range.last_rank = first_ranks_[node + 1];
+        }
+        range.first_rank = first_ranks_[node];
+        range.node = node;
+    }
+    return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include "memory_stats.h"
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Immutable trie of terms, built from all of them at once. Nodes are stored level by level and the children
+// of a node are consecutive and sorted by byte, so a node takes its byte, the index of its first child and
+// the rank of the first term below it: 9 bytes, against tens of bytes per term for a hash map or a tree.
+// Terms below a node have consecutive ranks in sorted order, so the terms with a prefix are one run of ids,
+// found in time of the prefix length.
+class TermTrie {
+public:
+    TermTrie();
+
+    // Pairs of term and id, sorted by term, every term once
+    explicit TermTrie(const std::vector<std::pair<std::string_view, int>>& terms);
+
+    // Id of the term, -1 if there is no such term
+    int Find(std::string_view term) const;
+
+    // Ids of the terms starting with the prefix, in the order of the terms
+    std::pair<const int*, const int*> FindPrefix(std::string_view prefix) const;
+
+    size_t size() const;
+
+    size_t GetMemoryBytes() const;
+
+private:
+    // Node 0 is the root, its byte is not used
+    std::vector<uint8_t> labels_;
+    // Children of node i are [first_children_[i], first_children_[i + 1])
+    std::vector<uint32_t> first_children_;
+    std::vector<uint32_t> first_ranks_;
+    // Ids of the terms by rank
+    std::vector<int> ids_;
+
+    // Node and ranks [first_rank, last_rank) of the terms below it
+    struct NodeRange {
+        uint32_t node;
+        uint32_t first_rank;
+        uint32_t last_rank;
+    };
+
+    // Follows the bytes of the text from the root, false if no term starts with the text
+    bool Descend(std::string_view text, NodeRange& range) const;
+};
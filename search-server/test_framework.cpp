@@ -1,4 +1,9 @@
 #include "test_framework.h"
+#include "log_duration.h"
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
 
 void AssertImpl(bool value, const std::string& expr_str, const std::string& func_name, const std::string& file_name, int line_number, const std::string& hint) {
     if (!value) {
@@ -125,6 +130,36 @@ void TestStatusFilterWork() {
     const auto top_docs_b = server.FindTopDocuments("a b", DocumentStatus::BANNED);
     ASSERT_EQUAL(top_docs_b.size(), 1);
     ASSERT_EQUAL(top_docs_b[0].id, 2);
+
+    // A document coming back under another status leaves the bitmap of the old one
+    server.RemoveDocument(5);
+    server.AddDocument(5, "a b"s, DocumentStatus::BANNED, {1});
+    server.AddDocument(1'000'000, "a b"s, DocumentStatus::ACTUAL, {1});
+    auto is_actual = [](int, DocumentStatus status, int) {
+        return status == DocumentStatus::ACTUAL;
+    };
+    for (const QueryEvaluation evaluation : {QueryEvaluation::EXHAUSTIVE, QueryEvaluation::PRUNED}) {
+        server.SetQueryEvaluation(evaluation);
+        for (const auto& found : {server.FindTopDocuments("a b"s, DocumentStatus::ACTUAL),
+                                  server.FindTopDocuments(std::execution::par, "a b"s, DocumentStatus::ACTUAL)}) {
+            const auto expected = server.FindTopDocuments("a b"s, is_actual);
+            ASSERT_EQUAL(found.size(), 2u);
+            ASSERT_EQUAL(found[0].id, expected[0].id);
+            ASSERT_EQUAL(found[0].id, 1'000'000);
+            ASSERT_EQUAL(found[1].id, 1);
+        }
+    }
+    ASSERT_EQUAL(server.FindTopDocuments("a b"s, DocumentStatus::BANNED).size(), 2u);
+
+    DocumentBitmap bitmap;
+    bitmap.Insert(3);
+    bitmap.Insert(70'000);
+    bitmap.Erase(3);
+    bitmap.Erase(5'000);
+    ASSERT(!bitmap.Contains(3));
+    ASSERT(bitmap.Contains(70'000));
+    ASSERT(!bitmap.Contains(70'001));
+    ASSERT(!bitmap.Contains(100'000'000));
 }
 void TestRelevanceCalc() {
     SearchServer server("in the"s);
@@ -136,6 +171,333 @@ void TestRelevanceCalc() {
     ASSERT(top_docs[1].relevance - 0.2747 < EPSILON);
     ASSERT(top_docs[2].relevance - 0.1014 < EPSILON);
 }
+void TestRemoveDocument() {
+    SearchServer server("in the"s);
+    server.AddDocument(1, "cat in the city"s, DocumentStatus::ACTUAL, {1, 2, 3});
+    server.AddDocument(2, "cat with a dog"s, DocumentStatus::ACTUAL, {1, 2, 3});
+    server.AddDocument(3, "dog in the park"s, DocumentStatus::ACTUAL, {1, 2, 3});
+    server.RemoveDocument(1);
+    ASSERT(server.FindTopDocuments("city"s).empty());
+    const auto found_docs = server.FindTopDocuments("cat"s);
+    ASSERT_EQUAL(found_docs.size(), 1u);
+    ASSERT_EQUAL(found_docs[0].id, 2);
+    server.RemoveDocument(std::execution::par, 2);
+    ASSERT(server.FindTopDocuments(std::execution::par, "cat"s).empty());
+    ASSERT_EQUAL(server.FindTopDocuments("dog"s).size(), 1u);
+    const auto [words, status] = server.MatchDocument("dog cat"s, 3);
+    ASSERT_EQUAL(words.size(), 1u);
+    ASSERT_EQUAL(server.GetDocumentCount(), 1u);
+}
+void TestMaxResultCount() {
+    SearchServer server("in the"s);
+    for (int id = 0; id < 10; ++id) {
+        server.AddDocument(id, "cat in the city"s, DocumentStatus::ACTUAL, {id});
+    }
+    server.AddDocument(10, "dog in the city"s, DocumentStatus::ACTUAL, {1});
+    ASSERT_EQUAL(server.FindTopDocuments("cat"s).size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+    const auto top_docs = server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, 3);
+    ASSERT_EQUAL(top_docs.size(), 3u);
+    ASSERT_EQUAL(top_docs[0].id, 9);
+    ASSERT_EQUAL(top_docs[2].id, 7);
+    const auto par_docs = server.FindTopDocuments(std::execution::par, "cat"s, DocumentStatus::ACTUAL, 8);
+    ASSERT_EQUAL(par_docs.size(), 8u);
+    ASSERT_EQUAL(par_docs[7].id, 2);
+    ASSERT(server.FindTopDocuments("cat"s, DocumentStatus::ACTUAL, 0).empty());
+    // A limit far beyond the number of documents allocates nothing for it
+    for (const size_t huge_count : {std::numeric_limits<size_t>::max(), size_t{1} << 40}) {
+        ASSERT_EQUAL(server.FindTopDocuments("dog"s, DocumentStatus::ACTUAL, huge_count).size(), 1u);
+        ASSERT_EQUAL(server.FindTopDocuments(std::execution::par, "cat"s, DocumentStatus::ACTUAL, huge_count).size(), 10u);
+        ASSERT_EQUAL(server.FindTopDocumentsBatch({"cat"s}, huge_count).documents.size(), 10u);
+    }
+}
+void TestPrunedEvaluation() {
+    SearchServer server("in the"s);
+    server.AddDocument(1, "white cat and fashion collar"s, DocumentStatus::ACTUAL, {8, -3});
+    server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, {5, -12, 2, 1});
+    server.AddDocument(4, "groomed starling eugene"s, DocumentStatus::BANNED, {9});
+    server.AddDocument(5, "cat in the city with a dog"s, DocumentStatus::ACTUAL, {1, 2, 3});
+    server.AddDocument(6, "dog and cat and bird"s, DocumentStatus::ACTUAL, {4});
+    for (const std::string& query : {"fluffy groomed cat"s, "cat dog -bird"s, "and cat eyes tail"s, "starling"s}) {
+        for (size_t max_count : {1u, 2u, 5u}) {
+            server.SetQueryEvaluation(QueryEvaluation::EXHAUSTIVE);
+            const auto expected = server.FindTopDocuments(query, DocumentStatus::ACTUAL, max_count);
+            server.SetQueryEvaluation(QueryEvaluation::PRUNED);
+            const auto pruned = server.FindTopDocuments(query, DocumentStatus::ACTUAL, max_count);
+            ASSERT_EQUAL(pruned.size(), expected.size());
+            for (size_t i = 0; i < expected.size(); ++i) {
+                ASSERT_EQUAL(pruned[i].id, expected[i].id);
+                ASSERT(std::abs(pruned[i].relevance - expected[i].relevance) < EPSILON);
+            }
+        }
+    }
+}
+void TestSparseDocumentIds() {
+    SearchServer server("in the"s);
+    const std::vector<int> ids = {0, 4095, 4096, 1000000, 2147483647};
+    for (const int id : ids) {
+        server.AddDocument(id, "cat in the city"s, DocumentStatus::ACTUAL, {1});
+    }
+    server.AddDocument(7, "dog in the city"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(5000000, "cat and dog"s, DocumentStatus::ACTUAL, {1});
+    for (int i = 0; i < 2; ++i) {
+        const auto seq_docs = server.FindTopDocuments("cat -dog"s, DocumentStatus::ACTUAL, 10);
+        const auto par_docs = server.FindTopDocuments(std::execution::par, "cat -dog"s, DocumentStatus::ACTUAL, 10);
+        ASSERT_EQUAL(seq_docs.size(), ids.size());
+        ASSERT_EQUAL(par_docs.size(), ids.size());
+        for (size_t j = 0; j < ids.size(); ++j) {
+            ASSERT_EQUAL(seq_docs[j].id, ids[j]);
+            ASSERT_EQUAL(par_docs[j].id, ids[j]);
+        }
+    }
+}
+void TestConcurrentMap() {
+    ConcurrentMap<int, int> map(7);
+    std::vector<int> keys(10000);
+    std::iota(keys.begin(), keys.end(), -5000);
+    std::for_each(std::execution::par, keys.begin(), keys.end(), [&map](int key) {
+        map[key].ref_to_value += key;
+        map.Add(key, 1);
+        if (key % 3 == 0) {
+            map.Erase(key);
+        }
+    });
+    const auto entries = map.BuildSortedVector();
+    ASSERT_EQUAL(entries.size(), 6667u);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        ASSERT(entries[i].first % 3 != 0);
+        ASSERT_EQUAL(entries[i].second, entries[i].first + 1);
+        ASSERT(i == 0 || entries[i - 1].first < entries[i].first);
+    }
+    ASSERT_EQUAL(map.BuildOrdinaryMap().size(), entries.size());
+}
+void TestProcessQueries() {
+    SearchServer server("and with"s);
+    int id = 0;
+    for (const std::string& text : {"funny pet and nasty rat"s, "funny pet with curly hair"s, "nasty rat with curly hair"s,
+                                    "pet with rat and rat and rat"s, "big cat nasty hair"s, "big dog cat Vladislav"s}) {
+        server.AddDocument(++id, text, DocumentStatus::ACTUAL, {1, 2});
+    }
+    server.AddDocument(++id, "nasty rat"s, DocumentStatus::BANNED, {1});
+    const std::vector<std::string> queries = {"nasty rat -not"s, "not very funny nasty pet"s, "curly hair"s,
+                                              "nasty rat -not"s, "rat  nasty -not rat"s, "unknown"s, "curly hair"s};
+    const auto batch = ProcessQueriesBatch(server, queries);
+    const auto per_query = ProcessQueries(server, queries);
+    const auto joined = ProcessQueriesJoined(server, queries);
+    ASSERT_EQUAL(batch.GetQueryCount(), queries.size());
+    ASSERT_EQUAL(per_query.size(), queries.size());
+    size_t joined_index = 0;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const auto expected = server.FindTopDocuments(queries[i]);
+        ASSERT_EQUAL(batch.GetDocuments(i).size(), expected.size());
+        ASSERT_EQUAL(per_query[i].size(), expected.size());
+        for (size_t j = 0; j < expected.size(); ++j) {
+            ASSERT_EQUAL(per_query[i][j].id, expected[j].id);
+            ASSERT_EQUAL(joined[joined_index++].id, expected[j].id);
+        }
+    }
+    ASSERT_EQUAL(joined_index, joined.size());
+    ASSERT(batch.GetDocuments(5).size() == 0);
+}
+void TestAddDocuments() {
+    const std::vector<std::string> texts = {"funny pet and nasty rat"s, "funny pet with curly hair"s, "nasty rat with curly hair"s,
+                                            "pet with rat and rat and rat"s, "big cat nasty hair"s, "big dog cat Vladislav"s};
+    SearchServer expected_server("and with"s);
+    SearchServer server("and with"s);
+    expected_server.AddDocument(10, "rat in the city"s, DocumentStatus::ACTUAL, {5});
+    server.AddDocument(10, "rat in the city"s, DocumentStatus::ACTUAL, {5});
+    std::vector<SearchServer::NewDocument> batch;
+    for (int i = 0; i < static_cast<int>(texts.size()); ++i) {
+        const int id = (i * 7) % 13;
+        expected_server.AddDocument(id, texts[i], DocumentStatus::ACTUAL, {i, 1});
+        batch.push_back({id, texts[i], DocumentStatus::ACTUAL, {i, 1}});
+    }
+    server.AddDocuments(batch);
+    ASSERT_EQUAL(server.GetDocumentCount(), expected_server.GetDocumentCount());
+    for (const std::string& query : {"nasty rat"s, "curly -cat"s, "big pet hair"s}) {
+        const auto expected = expected_server.FindTopDocuments(query);
+        const auto found = server.FindTopDocuments(query);
+        ASSERT_EQUAL(found.size(), expected.size());
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_EQUAL(found[i].id, expected[i].id);
+            ASSERT_EQUAL(found[i].rating, expected[i].rating);
+            ASSERT(std::abs(found[i].relevance - expected[i].relevance) < EPSILON);
+        }
+    }
+
+    auto is_rejected = [&server](const std::vector<SearchServer::NewDocument>& documents) {
+        try {
+            server.AddDocuments(documents);
+        } catch (const std::invalid_argument&) {
+            return true;
+        }
+        return false;
+    };
+    ASSERT(is_rejected({{20, "new cat"s, DocumentStatus::ACTUAL, {}}, {-1, "cat"s, DocumentStatus::ACTUAL, {}}}));
+    ASSERT(is_rejected({{20, "new cat"s, DocumentStatus::ACTUAL, {}}, {10, "cat"s, DocumentStatus::ACTUAL, {}}}));
+    ASSERT(is_rejected({{20, "new cat"s, DocumentStatus::ACTUAL, {}}, {20, "cat"s, DocumentStatus::ACTUAL, {}}}));
+    ASSERT(is_rejected({{20, "new cat"s, DocumentStatus::ACTUAL, {}}, {21, "cat\x12"s, DocumentStatus::ACTUAL, {}}}));
+    ASSERT_EQUAL(server.GetDocumentCount(), expected_server.GetDocumentCount());
+    ASSERT(server.FindTopDocuments("new"s).empty());
+}
+
+void TestSaveLoad() {
+    const std::string path = (std::filesystem::temp_directory_path() / "search_server_test.idx").string();
+    SearchServer server("and with"s);
+    server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+    server.AddDocument(3, "nasty rat with curly hair"s, DocumentStatus::BANNED, {1, 2, 3});
+    server.AddDocument(5, "big cat nasty hair"s, DocumentStatus::ACTUAL, {1, 2, 8});
+    server.AddDocument(8, "big dog cat Vladislav"s, DocumentStatus::ACTUAL, {1, 3, 2});
+    server.RemoveDocument(2);
+    server.Save(path);
+
+    SearchServer loaded = SearchServer::Load(path);
+    ASSERT_EQUAL(loaded.GetDocumentCount(), server.GetDocumentCount());
+    auto assert_same_results = [](const SearchServer& lhs, const SearchServer& rhs, const std::string& query) {
+        for (const DocumentStatus status : {DocumentStatus::ACTUAL, DocumentStatus::BANNED}) {
+            const auto expected = lhs.FindTopDocuments(query, status);
+            const auto found = rhs.FindTopDocuments(query, status);
+            ASSERT_EQUAL(found.size(), expected.size());
+            for (size_t i = 0; i < expected.size(); ++i) {
+                ASSERT_EQUAL(found[i].id, expected[i].id);
+                ASSERT_EQUAL(found[i].rating, expected[i].rating);
+                ASSERT(std::abs(found[i].relevance - expected[i].relevance) < EPSILON);
+            }
+        }
+    };
+    for (const std::string& query : {"nasty rat"s, "curly -cat"s, "big pet hair with"s, "funny"s}) {
+        assert_same_results(server, loaded, query);
+    }
+    ASSERT(loaded.GetWordFrequencies(5) == server.GetWordFrequencies(5));
+    ASSERT(loaded.GetWordFrequencies(2).empty());
+    ASSERT(std::get<0>(loaded.MatchDocument("nasty -dog"s, 3)) == std::vector<std::string_view>{"nasty"sv});
+
+    // A loaded server keeps accepting changes, and can be saved again
+    loaded.AddDocument(9, "curly cat and new rat"s, DocumentStatus::ACTUAL, {4});
+    server.AddDocument(9, "curly cat and new rat"s, DocumentStatus::ACTUAL, {4});
+    loaded.RemoveDocument(1);
+    server.RemoveDocument(1);
+    loaded.RemoveDocument(std::execution::par, 8);
+    server.RemoveDocument(std::execution::par, 8);
+    for (const std::string& query : {"nasty rat"s, "new cat"s, "big -hair dog"s}) {
+        assert_same_results(server, loaded, query);
+    }
+    loaded.Save(path);
+    const SearchServer reloaded = SearchServer::Load(path);
+    ASSERT_EQUAL(reloaded.GetDocumentCount(), server.GetDocumentCount());
+    for (const std::string& query : {"nasty rat"s, "new cat"s, "curly hair"s}) {
+        assert_same_results(server, reloaded, query);
+    }
+
+    {
+        // A rewrite merge still reads blocks borrowed from the snapshot when the server goes away
+        SearchServer large(""s);
+        std::vector<int> removed_ids;
+        for (int id = 0; id < 20000; ++id) {
+            large.AddDocument(id, "word"s + std::to_string(id % 97) + " common text"s, DocumentStatus::ACTUAL, {1});
+            if (id % 3 == 0) {
+                removed_ids.push_back(id);
+            }
+        }
+        large.Save(path);
+        SearchServer loaded_large = SearchServer::Load(path);
+        SearchServer compacted = loaded_large.Fork();
+        compacted.Compact();
+        loaded_large.RemoveDocuments(removed_ids);
+        ASSERT_EQUAL(compacted.FindTopDocuments("word5"s).size(), 5u);
+    }
+
+    {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out << "not a snapshot"s;
+    }
+    bool is_rejected = false;
+    try {
+        SearchServer::Load(path);
+    } catch (const std::runtime_error&) {
+        is_rejected = true;
+    }
+    ASSERT(is_rejected);
+    std::filesystem::remove(path);
+}
+
+void TestTextStorage() {
+    TextArena arena(8);
+    const std::string long_text = "longer than a chunk"s;
+    const std::string_view first = arena.Store("cat"sv);
+    const std::string_view second = arena.Store(long_text);
+    const std::string_view third = arena.Store("dog"sv);
+    ASSERT_EQUAL(first, "cat"sv);
+    ASSERT_EQUAL(second, long_text);
+    ASSERT_EQUAL(third, "dog"sv);
+    ASSERT(second.data() != long_text.data());
+    ASSERT_EQUAL(arena.GetUsedBytes(), 6 + long_text.size());
+
+    TermPool pool(3);
+    ASSERT_EQUAL(pool.Find("cat"sv), -1);
+    ASSERT_EQUAL(pool.Add("cat"sv), 3);
+    ASSERT_EQUAL(pool.Add("dog"sv), 4);
+    ASSERT_EQUAL(pool.Add(std::string("cat"s)), 3);
+    ASSERT_EQUAL(pool.Get(4), "dog"sv);
+    ASSERT_EQUAL(pool.GetNextId(), 5);
+
+    SearchServer server("in the"s);
+    {
+        std::string text = "curly cat in the city"s;
+        server.AddDocument(1, text, DocumentStatus::ACTUAL, {1});
+        std::vector<std::string> batch_texts = {"curly dog"s, "big cat"s};
+        server.AddDocuments({{2, batch_texts[0], DocumentStatus::ACTUAL, {2}},
+                             {3, batch_texts[1], DocumentStatus::ACTUAL, {3}}});
+        text.assign(text.size(), 'x');
+        batch_texts[0].assign(batch_texts[0].size(), 'x');
+    }
+    // Words of the first document stay in the dictionary after it is removed
+    const std::map<std::string_view, double> word_freqs = server.GetWordFrequencies(2);
+    server.RemoveDocument(1);
+    ASSERT_EQUAL(word_freqs.count("curly"sv), 1u);
+    ASSERT_EQUAL(server.FindTopDocuments("curly"s).size(), 1u);
+    ASSERT_EQUAL(server.FindTopDocuments("cat"s)[0].id, 3);
+    ASSERT_EQUAL(server.FindTopDocuments("x"s).size(), 0u);
+}
+
+void TestSplitIntoWords() {
+    auto split_naive = [](std::string_view text, std::vector<std::string_view>& words) {
+        bool is_valid = true;
+        std::string_view::size_type start = std::string_view::npos;
+        for (size_t i = 0; i <= text.size(); ++i) {
+            if (i < text.size() && static_cast<unsigned char>(text[i]) < ' ') {
+                is_valid = false;
+            }
+            if (i == text.size() || text[i] == ' ') {
+                if (start != std::string_view::npos) {
+                    words.push_back(text.substr(start, i - start));
+                    start = std::string_view::npos;
+                }
+            } else if (start == std::string_view::npos) {
+                start = i;
+            }
+        }
+        return is_valid;
+    };
+
+    // Lengths cross every block boundary of the vectorized scan
+    const std::string alphabet = "  ab\xc3\xff!\n\x1f"s;
+    std::mt19937 generator(42);
+    for (int i = 0; i < 2000; ++i) {
+        const bool with_controls = i % 3 == 0;
+        std::string text;
+        for (size_t length = generator() % 200; text.size() < length;) {
+            const char c = alphabet[generator() % alphabet.size()];
+            text += (with_controls || static_cast<unsigned char>(c) >= ' ') ? c : 'z';
+        }
+        std::vector<std::string_view> expected;
+        std::vector<std::string_view> words;
+        ASSERT_EQUAL(SplitIntoValidWords(text, words), split_naive(text, expected));
+        ASSERT(words == expected);
+    }
+    ASSERT(SplitIntoWords("  cat   in the\tcity "s) == (std::vector<std::string_view>{"cat"sv, "in"sv, "the\tcity"sv}));
+}
 void TestAddDocumentsExeption() {
     try {
         SearchServer server("test_stop_words"s);
@@ -185,14 +547,813 @@ void FindTopDocumentsExeption() {
         std::cout << "exeption?"s;
     }
 }
+void TestPostingList() {
+    std::map<int, PostingEntry> expected;
+    DocumentLengths lengths;
+    PostingList postings;
+    auto check = [&](const PostingList& list) {
+        ASSERT_EQUAL(list.size(), expected.size());
+        std::vector<std::pair<int, double>> actual;
+        list.ForEach(lengths, [&actual](const Posting& posting) {
+            actual.emplace_back(posting.document_id, posting.term_freq);
+        });
+        ASSERT_EQUAL(actual.size(), expected.size());
+        double max_term_freq = 0.0;
+        auto it = expected.begin();
+        for (const auto& [document_id, term_freq] : actual) {
+            ASSERT_EQUAL(document_id, it->first);
+            ASSERT_EQUAL(term_freq, it->second.GetTermFreq());
+            max_term_freq = std::max(max_term_freq, term_freq);
+            ++it;
+        }
+        ASSERT_EQUAL(list.GetMaxTermFreq(), max_term_freq);
+    };
+
+    // Ids and occurrences take from one to four bytes, insertions land in sealed blocks and in the tail.
+    // Blocks keep no lengths, they are decoded with those of lengths.
+    std::mt19937 generator(7);
+    auto random_entry = [&generator, &lengths](int document_id) {
+        const int length = static_cast<int>(generator() % 100000) + 1;
+        lengths.Set(document_id, length);
+        return PostingEntry{document_id, static_cast<int>(generator() % length) + 1, length};
+    };
+    for (int i = 0; i < 1000; ++i) {
+        const int document_id = i * 3000;
+        expected[document_id] = random_entry(document_id);
+        postings.Insert(expected[document_id], lengths);
+    }
+    for (int i = 0; i < 300; ++i) {
+        const int document_id = static_cast<int>(generator() % 3000000);
+        if (expected.count(document_id) > 0) {
+            expected.erase(document_id);
+            postings.Erase(document_id, lengths);
+        } else {
+            expected[document_id] = random_entry(document_id);
+            postings.Insert(expected[document_id], lengths);
+        }
+    }
+    check(postings);
+
+    std::vector<PostingEntry> batch;
+    for (int document_id = 1; document_id < 3000000; document_id += 7001) {
+        if (expected.count(document_id) == 0) {
+            expected[document_id] = random_entry(document_id);
+            batch.push_back(expected[document_id]);
+        }
+    }
+    postings.Merge(batch, lengths);
+    check(postings);
+    for (const auto& [document_id, entry] : expected) {
+        ASSERT(postings.Contains(document_id));
+        ASSERT_EQUAL(postings.Contains(document_id + 1), expected.count(document_id + 1) > 0);
+    }
+
+    PostingCursor cursor(postings, lengths, 1000000, 2000000);
+    ASSERT_EQUAL(cursor.Get().document_id, expected.lower_bound(1000000)->first);
+    cursor.SeekTo(1500000);
+    ASSERT_EQUAL(cursor.Get().document_id, expected.lower_bound(1500000)->first);
+    cursor.SeekTo(2000000);
+    ASSERT(cursor.IsEnd());
+
+    // A list borrowed from encoded blocks reads the same and is copied on the first change.
+    // Encode appends, the offsets of the blocks start at the first byte it added.
+    std::vector<PostingBlock> blocks;
+    std::vector<uint8_t> data(5);
+    postings.Encode(blocks, data);
+    PostingList borrowed = PostingList::Borrow(blocks.data(), blocks.size(), data.data() + 5, postings.size(),
+                                               postings.GetMaxTermFreq());
+    ASSERT(borrowed.IsBorrowed());
+    ASSERT_EQUAL(borrowed.GetMemoryBytes(), 0u);
+    check(borrowed);
+    expected.erase(3000);
+    borrowed.Erase(3000, lengths);
+    ASSERT(!borrowed.IsBorrowed());
+    check(borrowed);
+    ASSERT(!borrowed.Contains(3000));
+    ASSERT(postings.Contains(3000));
+}
+
+void TestResultCache() {
+    SearchServer server("and in"s);
+    server.AddDocument(1, "white cat and fancy collar"s, DocumentStatus::ACTUAL, {8});
+    server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, {7});
+    server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::BANNED, {5});
+    const std::vector<Document> uncached = server.FindTopDocuments("fluffy groomed cat"s);
+    auto is_uncached = [&uncached](const std::vector<Document>& documents) {
+        return std::equal(documents.begin(), documents.end(), uncached.begin(), uncached.end(),
+                          [](const Document& lhs, const Document& rhs) {
+                              return lhs.id == rhs.id && lhs.relevance == rhs.relevance && lhs.rating == rhs.rating;
+                          });
+    };
+    server.SetResultCacheSize(1 << 20);
+
+    ASSERT(is_uncached(server.FindTopDocuments("fluffy groomed cat"s)));
+    // Word order, repeats and stop words do not change the key
+    ASSERT(is_uncached(server.FindTopDocuments("cat and groomed fluffy cat"s)));
+    ResultCacheStats stats = server.GetResultCacheStats();
+    ASSERT_EQUAL(stats.misses, 1u);
+    ASSERT_EQUAL(stats.hits, 1u);
+    ASSERT_EQUAL(stats.entry_count, 1u);
+
+    ASSERT_EQUAL(server.FindTopDocuments("fluffy groomed cat"s, DocumentStatus::BANNED)[0].id, 3);
+    ASSERT_EQUAL(server.FindTopDocuments("fluffy groomed cat -tail"s).size(), 1u);
+    server.FindTopDocuments("fluffy groomed cat"s, [](int, DocumentStatus, int) { return true; });
+    stats = server.GetResultCacheStats();
+    ASSERT_EQUAL(stats.misses, 3u);
+    ASSERT_EQUAL(stats.hits, 1u);
+
+    // A change of the documents makes earlier results stale
+    server.AddDocument(4, "fluffy fluffy fluffy"s, DocumentStatus::ACTUAL, {9});
+    ASSERT_EQUAL(server.FindTopDocuments("cat fluffy groomed"s)[0].id, 4);
+    server.RemoveDocument(4);
+    ASSERT(is_uncached(server.FindTopDocuments(std::execution::par, "cat fluffy groomed"s)));
+    stats = server.GetResultCacheStats();
+    ASSERT_EQUAL(stats.misses, 5u);
+    ASSERT_EQUAL(stats.hits, 1u);
+
+    SearchServer small_server("and in"s);
+    small_server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, {8});
+    small_server.SetResultCacheSize(8 * 1024);
+    for (int i = 0; i < 100; ++i) {
+        small_server.FindTopDocuments("cat word"s + std::to_string(i));
+    }
+    stats = small_server.GetResultCacheStats();
+    ASSERT(stats.evictions > 0);
+    ASSERT(stats.used_bytes <= 8 * 1024);
+    ASSERT_EQUAL(stats.entry_count + stats.evictions, 100u);
+}
+
+void TestConcurrentSearchServer() {
+    SearchServer original("and in"s);
+    original.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, {1});
+    SearchServer fork = original.Fork();
+    fork.AddDocument(2, "black cat"s, DocumentStatus::ACTUAL, {2});
+    fork.RemoveDocument(1);
+    ASSERT_EQUAL(original.GetDocumentCount(), 1);
+    ASSERT_EQUAL(original.FindTopDocuments("cat"s)[0].id, 1);
+    ASSERT_EQUAL(fork.FindTopDocuments("cat"s)[0].id, 2);
+
+    // Forks share pages and texts with the server they came from and are changed from two threads at once
+    SearchServer paged("and in"s);
+    paged.SetPositionalIndex(true);
+    std::vector<int> paged_ids;
+    for (int id = 0; id < 1000; ++id) {
+        paged.AddDocument(id, "shared word"s + std::to_string(id), DocumentStatus::ACTUAL, {1});
+        paged_ids.push_back(id);
+    }
+    SearchServer left = paged.Fork();
+    SearchServer right = paged.Fork();
+    auto replace_documents = [](SearchServer& server, int first_id, const std::string& word) {
+        for (int id = first_id; id < 1000; id += 2) {
+            server.RemoveDocument(id);
+            server.AddDocument(1000 + id, word + " word"s + std::to_string(id), DocumentStatus::BANNED, {2});
+        }
+    };
+    std::thread left_writer(replace_documents, std::ref(left), 0, "left"s);
+    replace_documents(right, 1, "right"s);
+    left_writer.join();
+    ASSERT(std::vector<int>(paged.begin(), paged.end()) == paged_ids);
+    ASSERT_EQUAL(paged.FindTopDocuments("\"shared word7\""s).size(), 1u);
+    ASSERT(paged.FindTopDocuments("left right"s, DocumentStatus::BANNED).empty());
+    ASSERT_EQUAL(left.FindTopDocuments("shared"s, DocumentStatus::ACTUAL, 1000).size(), 500u);
+    ASSERT_EQUAL(left.FindTopDocuments("\"left word8\""s, DocumentStatus::BANNED).size(), 1u);
+    ASSERT_EQUAL(right.GetWordFrequencies(0).size(), 2u);
+    ASSERT(right.GetWordFrequencies(1).empty());
+    ASSERT(std::get<1>(right.MatchDocument("right"s, 1001)) == DocumentStatus::BANNED);
+
+    ConcurrentSearchServer server(std::move(original));
+    const std::shared_ptr<const SearchServer> first_version = server.GetSnapshot();
+    // Documents come in pairs published at once, so every version readers see holds whole pairs
+    std::atomic<bool> is_done = false;
+    auto read = [&server, &is_done]() {
+        while (!is_done) {
+            const std::shared_ptr<const SearchServer> version = server.GetSnapshot();
+            const size_t pair_count = version->GetDocumentCount() / 2;
+            ASSERT_EQUAL(version->GetDocumentCount() % 2, 1);
+            ASSERT_EQUAL(version->FindTopDocuments("pair"s, DocumentStatus::ACTUAL, 1000).size(), 2 * pair_count);
+            ASSERT_EQUAL(ProcessQueries(server, {"cat"s})[0].size(), 1u);
+        }
+    };
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 2; ++i) {
+        readers.emplace_back(read);
+    }
+    for (int i = 0; i < 50; ++i) {
+        server.Update([i](SearchServer& next) {
+            next.AddDocument(10 + 2 * i, "pair left"s, DocumentStatus::ACTUAL, {1});
+            next.AddDocument(11 + 2 * i, "pair right"s, DocumentStatus::ACTUAL, {1});
+        });
+        if (i % 5 == 4) {
+            server.Update([i](SearchServer& next) {
+                next.RemoveDocument(2 * i + 2);
+                next.RemoveDocument(2 * i + 3);
+            });
+        }
+    }
+    is_done = true;
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+
+    // A failed update publishes nothing
+    const size_t document_count = server.GetDocumentCount();
+    try {
+        server.Update([](SearchServer& next) {
+            next.AddDocument(1000, "pair"s, DocumentStatus::ACTUAL, {1});
+            next.AddDocument(1, "pair"s, DocumentStatus::ACTUAL, {1});
+        });
+        ASSERT(false);
+    } catch (const std::invalid_argument&) {
+    }
+    ASSERT_EQUAL(server.GetDocumentCount(), document_count);
+    ASSERT_EQUAL(first_version->GetDocumentCount(), 1);
+    ASSERT_EQUAL(std::get<0>(server.MatchDocument("white pair"s, 1)).size(), 1u);
+
+    // Matched words outlive the version they came from
+    ConcurrentSearchServer matched("and"s);
+    matched.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, {1});
+    const auto [words, status] = matched.MatchDocument("white dog"s, 1);
+    matched.Update([](SearchServer& next) {
+        next.RemoveDocument(1);
+        next.Compact();
+    });
+    ASSERT(words == std::vector<std::string>{"white"s});
+    ASSERT(status == DocumentStatus::ACTUAL);
+}
+
+void TestSegmentedIndex() {
+    SearchServer reference("and in"s);
+    SearchServer segmented("and in"s);
+    segmented.SetSegmentOptions({4, 2, true});
+    const std::vector<std::string> words = {"cat"s, "dog"s, "tail"s, "eyes"s, "collar"s, "city"s};
+    for (int id = 0; id < 60; ++id) {
+        std::string text = words[id % words.size()] + " "s + words[id * 7 % 5] + " in "s + words[id % 4];
+        reference.AddDocument(id, text, static_cast<DocumentStatus>(id % 2), {id});
+        segmented.AddDocument(id, text, static_cast<DocumentStatus>(id % 2), {id});
+    }
+    ASSERT(segmented.GetSegmentCount() > 1);
+    // Removed documents leave postings in sealed segments, a document may come back with other words
+    for (int id = 0; id < 60; id += 3) {
+        reference.RemoveDocument(id);
+        segmented.RemoveDocument(id);
+    }
+    reference.AddDocument(6, "dog dog collar"s, DocumentStatus::ACTUAL, {100});
+    segmented.AddDocument(6, "dog dog collar"s, DocumentStatus::ACTUAL, {100});
+
+    auto check = [&]() {
+        for (const std::string& query : {"cat dog"s, "tail -city"s, "collar eyes dog"s, "dog -cat"s}) {
+            for (const QueryEvaluation evaluation : {QueryEvaluation::EXHAUSTIVE, QueryEvaluation::PRUNED}) {
+                segmented.SetQueryEvaluation(evaluation);
+                const std::vector<Document> expected = reference.FindTopDocuments(query, DocumentStatus::ACTUAL, 10);
+                for (const std::vector<Document>& found : {segmented.FindTopDocuments(query, DocumentStatus::ACTUAL, 10),
+                                                           segmented.FindTopDocuments(std::execution::par, query,
+                                                                                      DocumentStatus::ACTUAL, 10)}) {
+                    ASSERT_EQUAL(found.size(), expected.size());
+                    for (size_t i = 0; i < found.size(); ++i) {
+                        ASSERT_EQUAL(found[i].id, expected[i].id);
+                        ASSERT_EQUAL(found[i].relevance, expected[i].relevance);
+                    }
+                }
+            }
+        }
+        ASSERT(std::get<0>(segmented.MatchDocument("dog collar cat"s, 6)) == std::get<0>(reference.MatchDocument("dog collar cat"s, 6)));
+        ASSERT_EQUAL(segmented.GetDocumentCount(), reference.GetDocumentCount());
+    };
+    check();
+    segmented.WaitForMerges();
+    check();
+    // Merges keep the number of segments logarithmic in the number of postings
+    ASSERT(segmented.GetSegmentCount() <= 8);
+}
+
+void TestSealedSegment() {
+    // Lists of a few postings stay in their tails until the segment is sealed
+    IndexSegment segment;
+    std::map<int, std::vector<std::pair<int, double>>> expected;
+    for (int id = 0; id < 300; ++id) {
+        const int length = id % 7 + 2;
+        segment.AddDocument(id, length);
+        for (int word_id = 0; word_id < 50; word_id += id % 5 + 1) {
+            const int occurrences = word_id % 2 + 1;
+            segment.InsertPosting(word_id, {id, occurrences, length});
+            expected[word_id].emplace_back(id, static_cast<double>(occurrences) / length);
+        }
+    }
+    const size_t unsealed_bytes = segment.GetMemoryBytes();
+    segment.Seal();
+    ASSERT(segment.GetMemoryBytes() < unsealed_bytes);
+    for (const auto& [word_id, postings] : expected) {
+        const PostingList* list = segment.GetPostings(word_id);
+        ASSERT(list != nullptr && list->IsBorrowed());
+        std::vector<std::pair<int, double>> actual;
+        list->ForEach(segment.GetDocumentLengths(), [&actual](const Posting& posting) {
+            actual.emplace_back(posting.document_id, posting.term_freq);
+        });
+        ASSERT(actual == postings);
+    }
+
+    // A merge seals its result, lengths of the inputs come along
+    const RemovedDocuments removed = {1, 2, 3};
+    const IndexSegment merged = IndexSegment::Merge({&segment}, {&removed});
+    const PostingList* list = merged.GetPostings(0);
+    ASSERT(list != nullptr && list->IsBorrowed());
+    ASSERT_EQUAL(list->size(), expected[0].size() - removed.size());
+    ASSERT_EQUAL(merged.GetDocumentLengths().Get(4), 6);
+    ASSERT_EQUAL(merged.GetDocumentLengths().Get(2), 0);
+}
+
+void TestCompaction() {
+    SearchServer server("and in"s);
+    server.SetSegmentOptions({64, 2, false});
+    for (int id = 0; id < 100; ++id) {
+        server.AddDocument(id, "cat word"s + std::to_string(id) + " dog tail"s, DocumentStatus::ACTUAL, {id});
+    }
+    for (int id = 0; id < 100; id += 2) {
+        server.RemoveDocument(id);
+    }
+    const MemoryStats before = server.GetMemoryStats();
+    ASSERT_EQUAL(before.term_count, 103u);
+    ASSERT_EQUAL(before.dead_term_count, 50u);
+    const std::vector<Document> expected = server.FindTopDocuments("cat word41 -word43"s, DocumentStatus::ACTUAL, 10);
+
+    server.Compact();
+    const MemoryStats after = server.GetMemoryStats();
+    ASSERT_EQUAL(after.term_count, 53u);
+    ASSERT_EQUAL(after.dead_term_count, 0u);
+    ASSERT(after.dictionary_bytes < before.dictionary_bytes);
+    ASSERT(after.posting_bytes < before.posting_bytes);
+    const std::vector<Document> found = server.FindTopDocuments("cat word41 -word43"s, DocumentStatus::ACTUAL, 10);
+    ASSERT_EQUAL(found.size(), expected.size());
+    for (size_t i = 0; i < found.size(); ++i) {
+        ASSERT_EQUAL(found[i].id, expected[i].id);
+        ASSERT_EQUAL(found[i].relevance, expected[i].relevance);
+    }
+    ASSERT(std::get<0>(server.MatchDocument("word41 tail word2"s, 41)) == std::vector<std::string_view>({"tail"sv, "word41"sv}));
+    // Dropped words come back with new ids
+    server.AddDocument(2, "word2"s, DocumentStatus::ACTUAL, {});
+    ASSERT_EQUAL(server.FindTopDocuments("word2"s)[0].id, 2);
+
+    // Removals keep the share of dead terms within the limit
+    server.SetAutoCompaction(0.1);
+    for (int id = 1; id < 100; id += 2) {
+        server.RemoveDocument(id);
+        const MemoryStats stats = server.GetMemoryStats();
+        ASSERT(stats.dead_term_count * 10 <= stats.term_count);
+    }
+}
+
+void TestRemoveDuplicates() {
+    SearchServer server("and with"s);
+    server.AddDocument(1, "funny pet and nasty rat"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    server.AddDocument(2, "funny pet with curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+    server.AddDocument(3, "funny pet and curly hair"s, DocumentStatus::ACTUAL, {1, 2});
+    server.AddDocument(4, "funny funny pet and nasty nasty rat"s, DocumentStatus::ACTUAL, {1, 2});
+    server.AddDocument(5, "funny pet and not very nasty rat"s, DocumentStatus::ACTUAL, {1, 2});
+    server.AddDocument(6, "very nasty rat and not very funny pet"s, DocumentStatus::ACTUAL, {1, 2});
+    server.AddDocument(7, "pet with rat and rat and rat"s, DocumentStatus::ACTUAL, {1, 2});
+    ASSERT(FindDuplicates(server) == std::vector<int>({3, 4, 6}));
+
+    // Jaccard similarity of documents 1 and 5 is 4/6, of documents 1 and 7 is 2/4
+    ASSERT(FindDuplicates(server, {0.6}) == std::vector<int>({3, 4, 5, 6}));
+    ASSERT(FindDuplicates(server, {0.5}) == std::vector<int>({3, 4, 5, 6, 7}));
+
+    RemoveDuplicates(server, {0.6});
+    ASSERT_EQUAL(server.GetDocumentCount(), 3u);
+    ASSERT(std::vector<int>(server.begin(), server.end()) == std::vector<int>({1, 2, 7}));
+}
+
+void TestMatchDocuments() {
+    const std::vector<ForwardEntry> entries = {{1, 1}, {4, 2}, {5, 1}, {9, 1}, {12, 3}, {40, 1}};
+    std::vector<size_t> found;
+    IntersectWordIds(entries.data(), entries.data() + entries.size(), {0, 4, 10, 12, 40, 41},
+                     [&found](size_t i) { found.push_back(i); });
+    ASSERT(found == std::vector<size_t>({1, 3, 4}));
+
+    SearchServer server("and in"s);
+    server.AddDocument(1, "white cat and fancy collar"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::BANNED, {2});
+    server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, {3});
+    // Matched words are views into the query
+    const std::string query = "fluffy groomed cat -collar unknown"s;
+    const auto matches = server.MatchDocuments(query, {3, 1, 2});
+    ASSERT_EQUAL(matches.size(), 3u);
+    ASSERT(std::get<0>(matches[0]) == std::vector<std::string_view>({"groomed"sv}));
+    ASSERT(std::get<0>(matches[1]).empty());
+    ASSERT(std::get<0>(matches[2]) == std::vector<std::string_view>({"cat"sv, "fluffy"sv}));
+    ASSERT(std::get<1>(matches[2]) == DocumentStatus::BANNED);
+    ASSERT(std::get<0>(server.MatchDocument(std::execution::par, "unknown cat cat"s, 2))
+           == std::vector<std::string_view>({"cat"sv}));
+    try {
+        server.MatchDocuments("cat"s, {1, 4});
+        ASSERT_HINT(false, "Missing documents must be rejected"s);
+    } catch (const std::invalid_argument&) {
+    }
+}
+
+void TestMetrics() {
+    for (const uint64_t value : {0ull, 15ull, 16ull, 17ull, 1000ull, 123456789ull}) {
+        const size_t index = MetricsRegistry::GetBucketIndex(value);
+        ASSERT(value <= MetricsRegistry::GetBucketUpperBound(index));
+        ASSERT(index == 0 || value > MetricsRegistry::GetBucketUpperBound(index - 1));
+    }
+    ASSERT_EQUAL(MetricsRegistry::GetBucketIndex(uint64_t{1} << 50), MetricsRegistry::BUCKET_COUNT - 1);
+
+    MetricsRegistry registry;
+    const size_t requests = registry.GetCounterId("requests"sv);
+    const size_t latency = registry.GetHistogramId("latency"sv);
+    ASSERT_EQUAL(registry.GetCounterId("requests"sv), requests);
+    // Blocks of all threads are merged on read
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < 4; ++thread) {
+        threads.emplace_back([&registry, requests, latency]() {
+            for (uint64_t i = 1; i <= 100; ++i) {
+                registry.Add(requests);
+                registry.Record(latency, i * 1000);
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    const MetricsSnapshot snapshot = registry.GetSnapshot();
+    ASSERT_EQUAL(snapshot.counters[0].second, 400u);
+    const HistogramSnapshot& histogram = snapshot.histograms[0];
+    ASSERT_EQUAL(histogram.count, 400u);
+    ASSERT_EQUAL(histogram.max, 100'000u);
+    ASSERT(histogram.GetPercentile(0.5) >= 50'000 && histogram.GetPercentile(0.5) <= 50'000 * 17 / 16);
+    ASSERT_EQUAL(histogram.GetPercentile(1.0), 100'000u);
+
+    registry.SetEnabled(false);
+    {
+        ScopedTimer timer(latency, registry);
+    }
+    registry.Add(requests);
+    registry.SetEnabled(true);
+    ASSERT_EQUAL(registry.GetSnapshot().counters[0].second, 400u);
+    {
+        ScopedTimer timer(latency, registry);
+        timer.Switch(registry.GetHistogramId("next"sv));
+    }
+    ASSERT_EQUAL(registry.GetSnapshot().histograms[1].count, 1u);
+    ASSERT(registry.Export(MetricsFormat::JSON).find("\"latency\": {\"count\": 401"s) != std::string::npos);
+    ASSERT(registry.Export(MetricsFormat::TEXT).find("requests 400\n"s) != std::string::npos);
+
+    // Searches report every stage to the process registry
+    SearchServer server("and"s);
+    server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, {1});
+    const auto count_of = [](const std::string& name) {
+        for (const HistogramSnapshot& stage : GetMetrics().GetSnapshot().histograms) {
+            if (stage.name == name) {
+                return stage.count;
+            }
+        }
+        return uint64_t{0};
+    };
+    const uint64_t parsed = count_of("query.parse"s);
+    const uint64_t scored = count_of("query.scoring"s);
+    server.FindTopDocuments("cat"s);
+    server.FindTopDocuments(std::execution::par, "cat"s);
+    ASSERT_EQUAL(count_of("query.parse"s), parsed + 2);
+    ASSERT_EQUAL(count_of("query.scoring"s), scored + 2);
+    // Batches count every query and parse every distinct query string once
+    const auto counter_of = [](const std::string& name) {
+        for (const auto& [counter, value] : GetMetrics().GetSnapshot().counters) {
+            if (counter == name) {
+                return value;
+            }
+        }
+        return uint64_t{0};
+    };
+    const uint64_t asked = counter_of("query.count"s);
+    server.FindTopDocumentsBatch({"cat"s, "cat"s, "white"s});
+    ASSERT_EQUAL(counter_of("query.count"s), asked + 3);
+    ASSERT_EQUAL(count_of("query.parse"s), parsed + 4);
+    ASSERT_EQUAL(count_of("query.scoring"s), scored + 4);
+
+    // Names past the limit get an id that records nothing
+    MetricsRegistry full;
+    for (size_t i = 0; i < MetricsRegistry::MAX_HISTOGRAMS; ++i) {
+        ASSERT_EQUAL(full.GetHistogramId("stage"s + std::to_string(i)), i);
+    }
+    ASSERT_EQUAL(full.GetHistogramId("extra"sv), MetricsRegistry::NO_METRIC_ID);
+    full.Record(MetricsRegistry::NO_METRIC_ID, 1000);
+    full.Add(MetricsRegistry::NO_METRIC_ID);
+    ASSERT_EQUAL(full.GetSnapshot().histograms.size(), MetricsRegistry::MAX_HISTOGRAMS);
+    // Labels of LogDuration cannot take the names of the query metrics
+    std::ostringstream log;
+    for (size_t i = 0; i <= MetricsRegistry::MAX_HISTOGRAMS; ++i) {
+        LOG_DURATION_STREAM("label"s + std::to_string(i), log);
+    }
+    server.FindTopDocuments("cat"s);
+    ASSERT_EQUAL(count_of("query.parse"s), parsed + 5);
+}
+
+void TestRequestQueue() {
+    SearchServer server("and in at"s);
+    server.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, {7, 2, 7});
+    server.AddDocument(2, "curly dog and fancy collar"s, DocumentStatus::ACTUAL, {1, 2, 3});
+    server.AddDocument(3, "big cat fancy collar "s, DocumentStatus::ACTUAL, {1, 2, 8});
+    RequestQueue request_queue(server, 4);
+    for (int i = 0; i < 1439; ++i) {
+        request_queue.AddFindRequest("empty request"s);
+    }
+    request_queue.AddFindRequest("curly dog"s);
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1439);
+    // Every new request pushes the oldest one out of the window
+    request_queue.AddFindRequest("big collar"s);
+    request_queue.AddFindRequest("sparrow"s, DocumentStatus::BANNED);
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1438);
+
+    // Requests of several producers answered by the workers
+    std::vector<std::future<std::vector<Document>>> results;
+    std::mutex results_mutex;
+    std::vector<std::thread> producers;
+    for (int producer = 0; producer < 4; ++producer) {
+        producers.emplace_back([&]() {
+            for (int i = 0; i < 500; ++i) {
+                auto result = request_queue.AddFindRequestAsync("curly"s);
+                std::lock_guard<std::mutex> lock(results_mutex);
+                results.push_back(std::move(result));
+            }
+        });
+    }
+    for (std::thread& producer : producers) {
+        producer.join();
+    }
+    for (auto& result : results) {
+        ASSERT_EQUAL(result.get().size(), 2u);
+    }
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 0);
+
+    results.clear();
+    for (int i = 0; i < 2000; ++i) {
+        results.push_back(request_queue.AddFindRequestAsync("sparrow"s,
+                                                            [](int, DocumentStatus, int) {
+                                                                return true;
+                                                            }));
+    }
+    for (auto& result : results) {
+        ASSERT(result.get().empty());
+    }
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1440);
+}
+
+void TestSearchAfterCursor() {
+    SearchServer server("and"s);
+    // Ratings repeat, so many documents tie on relevance and rating
+    for (int id = 0; id < 300; ++id) {
+        server.AddDocument(id, "cat"s + (id % 3 == 0 ? " dog"s : ""s) + (id % 7 == 0 ? " cat"s : ""s),
+                           id % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, {id % 4});
+    }
+    const std::vector<Document> all = server.FindTopDocuments("cat dog"s, DocumentStatus::ACTUAL, 1000);
+    ASSERT_EQUAL(all.size(), 240u);
+    for (const QueryEvaluation evaluation : {QueryEvaluation::EXHAUSTIVE, QueryEvaluation::PRUNED}) {
+        server.SetQueryEvaluation(evaluation);
+        for (const bool is_parallel : {false, true}) {
+            std::vector<Document> paged;
+            std::optional<Document> after;
+            while (true) {
+                const std::vector<Document> page = is_parallel
+                        ? server.FindTopDocumentsAfter(std::execution::par, "cat dog"s, DocumentStatus::ACTUAL, after, 7)
+                        : server.FindTopDocumentsAfter("cat dog"s, DocumentStatus::ACTUAL, after, 7);
+                if (page.empty()) {
+                    break;
+                }
+                ASSERT(page.size() == 7u || paged.size() + page.size() == all.size());
+                paged.insert(paged.end(), page.begin(), page.end());
+                after = page.back();
+            }
+            ASSERT_EQUAL(paged.size(), all.size());
+            for (size_t i = 0; i < all.size(); ++i) {
+                ASSERT_EQUAL(paged[i].id, all[i].id);
+            }
+        }
+    }
+}
+
+void TestPhraseQueries() {
+    const std::string path = (std::filesystem::temp_directory_path() / "search_server_phrase_test.idx").string();
+    SearchServer server("the in"s);
+    server.AddDocument(1, "white cat in the big city"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "big white dog and cat"s, DocumentStatus::ACTUAL, {2});
+    server.AddDocument(3, "cat white cat big"s, DocumentStatus::ACTUAL, {3});
+    server.Save(path);
+
+    auto is_rejected = [](const SearchServer& searcher, const std::string& query) {
+        try {
+            searcher.FindTopDocuments(query);
+        } catch (const std::invalid_argument&) {
+            return true;
+        }
+        return false;
+    };
+    ASSERT(is_rejected(server, "\"white cat\""s));
+    // Positions of documents already added come from their texts
+    server.SetPositionalIndex(true);
+    server.AddDocuments({{4, "a white cat"s, DocumentStatus::ACTUAL, {4}}, {5, "cat white"s, DocumentStatus::BANNED, {5}}});
+    server.AddDocument(6, "white the cat"s, DocumentStatus::ACTUAL, {6});
+    ASSERT(is_rejected(server, "\"white cat"s));
+    ASSERT(is_rejected(server, "\"white -cat\""s));
+
+    auto ids = [](const std::vector<Document>& documents) {
+        std::vector<int> result;
+        for (const Document& document : documents) {
+            result.push_back(document.id);
+        }
+        std::sort(result.begin(), result.end());
+        return result;
+    };
+    for (const QueryEvaluation evaluation : {QueryEvaluation::EXHAUSTIVE, QueryEvaluation::PRUNED}) {
+        server.SetQueryEvaluation(evaluation);
+        // Stop words are left out of positions, so "white the cat" has the phrase too
+        ASSERT(ids(server.FindTopDocuments("\"white cat\""s)) == (std::vector<int>{1, 3, 4, 6}));
+        ASSERT(ids(server.FindTopDocuments(std::execution::par, "\"white cat\""s)) == (std::vector<int>{1, 3, 4, 6}));
+        ASSERT(ids(server.FindTopDocuments("\"cat big city\" dog"s)) == (std::vector<int>{1}));
+        ASSERT(ids(server.FindTopDocuments("\"white cat\" -big"s)) == (std::vector<int>{4, 6}));
+        ASSERT(ids(server.FindTopDocuments("\"cat white\""s, DocumentStatus::BANNED)) == (std::vector<int>{5}));
+        ASSERT(server.FindTopDocuments("\"cat city\" \"white dog\""s).empty());
+        ASSERT(server.FindTopDocuments("\"white mouse\""s).empty());
+    }
+    // Phrase words are scored as plus words
+    const std::vector<Document> phrase_results = server.FindTopDocuments("\"white cat\""s);
+    const std::vector<Document> word_results = server.FindTopDocuments("white cat"s);
+    for (const Document& document : phrase_results) {
+        const auto it = std::find_if(word_results.begin(), word_results.end(), [&document](const Document& other) {
+            return other.id == document.id;
+        });
+        ASSERT(it != word_results.end());
+        ASSERT(std::abs(it->relevance - document.relevance) < EPSILON);
+    }
+    const QueryBatchResult batch = server.FindTopDocumentsBatch({"\"white cat\""s, "white cat"s, "\"white  cat\""s});
+    ASSERT_EQUAL(batch.offsets[1] - batch.offsets[0], 4u);
+    ASSERT_EQUAL(batch.offsets[2] - batch.offsets[1], 5u);
+    ASSERT_EQUAL(batch.offsets[3] - batch.offsets[2], 4u);
+
+    ASSERT(std::get<0>(server.MatchDocument("\"white cat\" big"s, 3)) == (std::vector<std::string_view>{"big"sv, "cat"sv, "white"sv}));
+    ASSERT(std::get<0>(server.MatchDocument("\"white cat\" big"s, 2)).empty());
+
+    server.RemoveDocument(3);
+    server.Compact();
+    ASSERT(ids(server.FindTopDocuments("\"white cat\""s)) == (std::vector<int>{1, 4, 6}));
+    SearchServer fork = server.Fork();
+    fork.RemoveDocument(4);
+    ASSERT(ids(fork.FindTopDocuments("\"white cat\""s)) == (std::vector<int>{1, 6}));
+    ASSERT(ids(server.FindTopDocuments("\"white cat\""s)) == (std::vector<int>{1, 4, 6}));
+
+    // A removed document too small to squeeze its page leaves positions of dead words behind
+    SearchServer churned("the"s);
+    churned.SetPositionalIndex(true);
+    churned.AddDocument(1, "white cat sat on the mat by the door"s, DocumentStatus::ACTUAL, {});
+    churned.AddDocument(2, "red fox"s, DocumentStatus::ACTUAL, {});
+    churned.AddDocument(3, "big white cat ran away from the dog"s, DocumentStatus::ACTUAL, {});
+    churned.RemoveDocument(2);
+    churned.Compact();
+    churned.Compact();
+    churned.AddDocument(4, "cat white fox"s, DocumentStatus::ACTUAL, {});
+    ASSERT(ids(churned.FindTopDocuments("\"white cat\""s)) == (std::vector<int>{1, 3}));
+    ASSERT(ids(churned.FindTopDocuments("\"white fox\""s)) == (std::vector<int>{4}));
+
+    // Documents of a snapshot get positions from their mapped texts
+    SearchServer loaded = SearchServer::Load(path);
+    ASSERT(is_rejected(loaded, "\"white cat\""s));
+    loaded.SetPositionalIndex(true);
+    loaded.AddDocument(7, "white cat"s, DocumentStatus::ACTUAL, {});
+    ASSERT(ids(loaded.FindTopDocuments("\"white cat\""s)) == (std::vector<int>{1, 3, 7}));
+    std::filesystem::remove(path);
+}
+
+void TestPrefixQueries() {
+    const TermTrie trie({{"ca"sv, 4}, {"cat"sv, 1}, {"catalog"sv, 7}, {"cow"sv, 2}, {"dog"sv, 0}});
+    ASSERT_EQUAL(trie.Find("cat"sv), 1);
+    ASSERT_EQUAL(trie.Find("ca"sv), 4);
+    ASSERT_EQUAL(trie.Find("c"sv), -1);
+    ASSERT_EQUAL(trie.Find("cats"sv), -1);
+    ASSERT_EQUAL(trie.Find(""sv), -1);
+    auto prefix_ids = [&trie](std::string_view prefix) {
+        const auto [first, last] = trie.FindPrefix(prefix);
+        return std::vector<int>(first, last);
+    };
+    ASSERT(prefix_ids("ca"sv) == (std::vector<int>{4, 1, 7}));
+    ASSERT(prefix_ids("c"sv) == (std::vector<int>{4, 1, 7, 2}));
+    ASSERT(prefix_ids("e"sv).empty());
+    ASSERT_EQUAL(prefix_ids(""sv).size(), 5u);
+
+    // New terms are moved into the trie as they pile up, ids and views stay as they were
+    TermPool pool;
+    std::vector<std::string_view> views;
+    for (int i = 0; i < 3000; ++i) {
+        ASSERT_EQUAL(pool.Add("w"s + std::to_string(i)), i);
+        views.push_back(pool.Get(i));
+    }
+    for (int i = 0; i < 3000; i += 7) {
+        ASSERT_EQUAL(pool.Find("w"s + std::to_string(i)), i);
+        ASSERT_EQUAL(views[i], "w"s + std::to_string(i));
+    }
+    std::vector<int> found;
+    pool.FindPrefix("w29"sv, found);
+    std::sort(found.begin(), found.end());
+    ASSERT_EQUAL(found.size(), 111u);
+    ASSERT_EQUAL(found.front(), 29);
+
+    SearchServer server("and"s);
+    server.AddDocument(1, "cat and catalog"s, DocumentStatus::ACTUAL, {1});
+    server.AddDocument(2, "cats cat cat"s, DocumentStatus::ACTUAL, {2});
+    server.AddDocument(3, "dog category"s, DocumentStatus::ACTUAL, {3});
+    server.AddDocument(4, "dog"s, DocumentStatus::ACTUAL, {4});
+    server.AddDocument(5, "caterpillar"s, DocumentStatus::BANNED, {5});
+    auto is_rejected = [&server](const std::string& query) {
+        try {
+            server.FindTopDocuments(query);
+        } catch (const std::invalid_argument&) {
+            return true;
+        }
+        return false;
+    };
+    ASSERT(is_rejected("*"s));
+    ASSERT(is_rejected("dog -*"s));
+
+    auto ids = [](const std::vector<Document>& documents) {
+        std::vector<int> result;
+        for (const Document& document : documents) {
+            result.push_back(document.id);
+        }
+        return result;
+    };
+    std::vector<Document> expected;
+    for (const QueryEvaluation evaluation : {QueryEvaluation::EXHAUSTIVE, QueryEvaluation::PRUNED}) {
+        server.SetQueryEvaluation(evaluation);
+        // Words of the prefix are one word, as frequent as "cat", whose occurrences add up within a document
+        const std::vector<Document> found_documents = server.FindTopDocuments("cat*"s);
+        ASSERT(ids(found_documents) == (std::vector<int>{2, 1, 3}));
+        const double inverse_document_freq = std::log(5.0 / 2.0);
+        ASSERT(std::abs(found_documents[0].relevance - inverse_document_freq) < EPSILON);
+        ASSERT(std::abs(found_documents[1].relevance - inverse_document_freq) < EPSILON);
+        ASSERT(std::abs(found_documents[2].relevance - inverse_document_freq / 2) < EPSILON);
+        ASSERT(ids(server.FindTopDocuments(std::execution::par, "cat*"s)) == (std::vector<int>{2, 1, 3}));
+        ASSERT(ids(server.FindTopDocuments("dog -categ*"s)) == (std::vector<int>{4}));
+        ASSERT(ids(server.FindTopDocuments("cat* dog"s, DocumentStatus::BANNED)) == (std::vector<int>{5}));
+        ASSERT(server.FindTopDocuments("caterp*"s).empty());
+        ASSERT(server.FindTopDocuments("mouse*"s).empty());
+        if (expected.empty()) {
+            expected = server.FindTopDocuments("cat* dog"s);
+        }
+        const std::vector<Document> mixed = server.FindTopDocuments("dog cat*"s);
+        ASSERT_EQUAL(mixed.size(), expected.size());
+        for (size_t i = 0; i < mixed.size(); ++i) {
+            ASSERT_EQUAL(mixed[i].id, expected[i].id);
+            ASSERT(std::abs(mixed[i].relevance - expected[i].relevance) < EPSILON);
+        }
+    }
+    const QueryBatchResult batch = server.FindTopDocumentsBatch({"cat*"s, "cat"s, "cat* cat*"s});
+    ASSERT_EQUAL(batch.offsets[1] - batch.offsets[0], 3u);
+    ASSERT_EQUAL(batch.offsets[2] - batch.offsets[1], 2u);
+    ASSERT_EQUAL(batch.offsets[3] - batch.offsets[2], 3u);
+    ASSERT(std::get<0>(server.MatchDocument("cat* catalog"s, 1)) == (std::vector<std::string_view>{"cat"sv, "catalog"sv}));
+    ASSERT(std::get<0>(server.MatchDocument("dog -cats*"s, 2)).empty());
+
+    // Words of a loaded snapshot are found by prefix in its sorted table, later words in the pool
+    const std::string path = (std::filesystem::temp_directory_path() / "search_server_prefix_test.idx").string();
+    server.Save(path);
+    SearchServer loaded = SearchServer::Load(path);
+    loaded.AddDocument(6, "catfish"s, DocumentStatus::ACTUAL, {6});
+    loaded.RemoveDocument(2);
+    ASSERT(ids(loaded.FindTopDocuments("cat*"s)) == (std::vector<int>{6, 1, 3}));
+    loaded.Compact();
+    ASSERT(ids(loaded.FindTopDocuments("cat*"s)) == (std::vector<int>{6, 1, 3}));
+    std::filesystem::remove(path);
+}
+
 void TestSearchServer() {
     RUN_TEST(TestExcludeStopWordsFromAddedDocumentContent);
     RUN_TEST(TestAddingDocument);
     RUN_TEST(TestExcludeMinusWordsFromTopDocumentContent);
     RUN_TEST(TestMatchingDocuments);
+    RUN_TEST(TestMatchDocuments);
     RUN_TEST(TestRelevanceSort);
     RUN_TEST(TestComputeAverageRating);
     RUN_TEST(TestPredicateWork);
     RUN_TEST(TestStatusFilterWork);
     RUN_TEST(TestRelevanceCalc);
+    RUN_TEST(TestRemoveDocument);
+    RUN_TEST(TestMaxResultCount);
+    RUN_TEST(TestPrunedEvaluation);
+    RUN_TEST(TestSparseDocumentIds);
+    RUN_TEST(TestConcurrentMap);
+    RUN_TEST(TestProcessQueries);
+    RUN_TEST(TestAddDocuments);
+    RUN_TEST(TestSaveLoad);
+    RUN_TEST(TestTextStorage);
+    RUN_TEST(TestSplitIntoWords);
+    RUN_TEST(TestPostingList);
+    RUN_TEST(TestResultCache);
+    RUN_TEST(TestConcurrentSearchServer);
+    RUN_TEST(TestSegmentedIndex);
+    RUN_TEST(TestSealedSegment);
+    RUN_TEST(TestCompaction);
+    RUN_TEST(TestRemoveDuplicates);
+    RUN_TEST(TestMetrics);
+    RUN_TEST(TestRequestQueue);
+    RUN_TEST(TestSearchAfterCursor);
+    RUN_TEST(TestPhraseQueries);
+    RUN_TEST(TestPrefixQueries);
 }
\ No newline at end of file
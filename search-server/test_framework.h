@@ -1,5 +1,13 @@
 #pragma once
 #include "search_server.h"
+#include "process_queries.h"
+#include "concurrent_search_server.h"
+#include "text_arena.h"
+#include "term_pool.h"
+#include "document_bitmap.h"
+#include "metrics.h"
+#include "request_queue.h"
+#include "remove_duplicates.h"
 
 template <typename T, typename U>
 void AssertEqualImpl(const T& t, const U& u, const std::string& t_str, const std::string& u_str, const std::string& file,
@@ -39,6 +47,9 @@ void TestExcludeMinusWordsFromTopDocumentContent();
 // Тест проверяет, что в поисковой системе правильно находятся документы соответствующие поисковому запросу
 void TestMatchingDocuments();
 
+// Тест проверяет, что сопоставление запроса сразу с несколькими документами совпадает с MatchDocument для каждого.
+void TestMatchDocuments();
+
 // Тест проверяет, что поисковая система правильно сортирует документы по релевантности
 void TestRelevanceSort();
 
@@ -54,6 +65,72 @@ void TestStatusFilterWork();
 // Тест проверяет, что поисковая система правильно высчитывает релевантность.
 void TestRelevanceCalc();
 
+// Тест проверяет, что после удаления документа его слова остаются доступны для поиска в других документах.
+void TestRemoveDocument();
+
+// Тест проверяет, что поисковая система возвращает не больше запрошенного числа документов.
+void TestMaxResultCount();
+
+// Тест проверяет, что режим с отсечением документов находит те же документы, что и полный перебор.
+void TestPrunedEvaluation();
+
+// Тест проверяет поиск по документам с далеко разнесёнными идентификаторами.
+void TestSparseDocumentIds();
+
+// Тест проверяет вставку, удаление и снимок ConcurrentMap при работе из нескольких потоков.
+void TestConcurrentMap();
+
+// Тест проверяет, что пакетная обработка запросов совпадает с поиском по каждому запросу отдельно.
+void TestProcessQueries();
+
+// Тест проверяет пакетное добавление документов и его ошибки.
+void TestAddDocuments();
+
+// Тест проверяет, что сервер, загруженный из снимка, отвечает так же, как сохранённый, и продолжает изменяться.
+void TestSaveLoad();
+
+// Тест проверяет, что тексты документов и слова словаря хранятся сервером и не зависят от исходных строк.
+void TestTextStorage();
+
+// Тест проверяет, что разбиение на слова совпадает с посимвольным разбором и находит управляющие символы.
+void TestSplitIntoWords();
+
+// Тест проверяет, что сжатый список документов слова хранит их так же, как обычный отсортированный список.
+void TestPostingList();
+
+// Тест проверяет, что кэш результатов отдаёт те же документы, что и поиск, и сбрасывается при изменении документов.
+void TestResultCache();
+
+// Тест проверяет, что читатели видят только целые версии сервера, пока писатель добавляет и удаляет документы.
+void TestConcurrentSearchServer();
+
+// Тест проверяет, что индекс из нескольких сегментов с фоновым слиянием находит те же документы, что и обычный.
+void TestSegmentedIndex();
+
+// Тест проверяет, что запечатанный сегмент хранит списки в общем сжатом буфере и декодирует их по длинам документов.
+void TestSealedSegment();
+
+// Тест проверяет, что сжатие удаляет слова без документов и не меняет результаты поиска.
+void TestCompaction();
+
+// Тест проверяет поиск точных и почти точных дубликатов документов.
+void TestRemoveDuplicates();
+
+// Тест проверяет счётчики и гистограммы реестра метрик и запись этапов поиска.
+void TestMetrics();
+
+// Тест проверяет окно запросов RequestQueue и асинхронные запросы из нескольких потоков.
+void TestRequestQueue();
+
+// Тест проверяет, что страницы, полученные по курсору, вместе совпадают с полным результатом поиска.
+void TestSearchAfterCursor();
+
+// Тест проверяет, что фразы в кавычках находят только документы, где слова идут подряд.
+void TestPhraseQueries();
+
+// Тест проверяет поиск слов по префиксу в словаре и запросы со словами, оканчивающимися на '*'.
+void TestPrefixQueries();
+
 void TestAddDocumentsExeption();
 
 void FindTopDocumentsExeption();
@@ -0,0 +1,47 @@
+#include "text_arena.h"
+#include <algorithm>
+#include <cstring>
+
+TextArena::TextArena(size_t chunk_size)
+        : chunk_size_(std::max<size_t>(chunk_size, 1)) {
+}
+
+std::string_view TextArena::Store(std::string_view text) {
+    if (text.empty()) {
+        return {};
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    char* stored;
+    if (text.size() >= chunk_size_) {
+        // A text not smaller than a chunk gets a chunk of its own, the free tail of the current one stays usable
+        stored = AllocateChunk(text.size());
+    } else {
+        if (text.size() > free_size_) {
+            free_space_ = AllocateChunk(chunk_size_);
+            free_size_ = chunk_size_;
+        }
+        stored = free_space_;
+        free_space_ += text.size();
+        free_size_ -= text.size();
+    }
+    std::memcpy(stored, text.data(), text.size());
+    used_bytes_ += text.size();
+    return {stored, text.size()};
+}
+
+size_t TextArena::GetUsedBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return used_bytes_;
+}
+
+size_t TextArena::GetCapacity() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return capacity_;
+}
+
+char* TextArena::AllocateChunk(size_t size) {
+    // Not value-initialized, every byte is written before it is read
+    chunks_.emplace_back(new char[size]);
+    capacity_ += size;
+    return chunks_.back().get();
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+// Append-only storage for strings. Texts are copied into large chunks that never move,
+// so a view of a stored text stays valid for the lifetime of the arena.
+// Forks of a server share their arenas, so texts may be stored from several threads at once.
+class TextArena {
+public:
+    static constexpr size_t DEFAULT_CHUNK_SIZE = 64 * 1024;
+
+    explicit TextArena(size_t chunk_size = DEFAULT_CHUNK_SIZE);
+
+    std::string_view Store(std::string_view text);
+
+    // Bytes taken by stored texts
+    size_t GetUsedBytes() const;
+
+    // Bytes allocated for chunks
+    size_t GetCapacity() const;
+
+private:
+    mutable std::mutex mutex_;
+    size_t chunk_size_;
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    char* free_space_ = nullptr;
+    size_t free_size_ = 0;
+    size_t used_bytes_ = 0;
+    size_t capacity_ = 0;
+
+    char* AllocateChunk(size_t size);
+};
@@ -0,0 +1,65 @@
+#include "top_documents.h"
+#include <algorithm>
+#include <cmath>
+
+bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+    if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
+        if (lhs.rating == rhs.rating) {
+            return lhs.id < rhs.id;
+        }
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.relevance > rhs.relevance;
+}
+
+TopDocuments::TopDocuments(size_t max_count, const std::optional<Document>& after)
+        : max_count_(max_count)
+        , after_(after) {
+    // max_count comes from callers and may be huge, the heap grows from a small start like any vector
+    heap_.reserve(std::min<size_t>(max_count, MAX_RESERVED_COUNT));
+}
+
+void TopDocuments::Add(const Document& document) {
+    if (max_count_ == 0 || (after_ && !IsMoreRelevant(*after_, document))) {
+        return;
+    }
+    // The heap top is the worst kept document, so a new one only has to beat it
+    if (heap_.size() < max_count_) {
+        heap_.push_back(document);
+        std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    } else if (IsMoreRelevant(document, heap_.front())) {
+        std::pop_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+        heap_.back() = document;
+        std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    }
+}
+
+void TopDocuments::Merge(const TopDocuments& other) {
+    for (const Document& document : other.heap_) {
+        Add(document);
+    }
+}
+
+size_t TopDocuments::GetMaxCount() const {
+    return max_count_;
+}
+
+bool TopDocuments::IsFull() const {
+    return heap_.size() >= max_count_;
+}
+
+bool TopDocuments::CanKeep(double relevance) const {
+    if (max_count_ == 0 || (after_ && relevance > after_->relevance + EPSILON)) {
+        return false;
+    }
+    return heap_.size() < max_count_ || relevance > heap_.front().relevance - EPSILON;
+}
+
+const Document& TopDocuments::GetWorst() const {
+    return heap_.front();
+}
+
+std::vector<Document> TopDocuments::Extract() {
+    std::sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+    return std::move(heap_);
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include "document.h"
+#include <vector>
+#include <cstddef>
+#include <optional>
+
+constexpr double EPSILON = 1e-6;
+
+// Ranking order of search results: by relevance, then by rating, then by id
+bool IsMoreRelevant(const Document& lhs, const Document& rhs);
+
+// Keeps the best max_count documents seen so far in a bounded heap.
+// Given a document `after`, keeps only documents ranked after it, that is the page following it.
+class TopDocuments {
+public:
+    explicit TopDocuments(size_t max_count, const std::optional<Document>& after = std::nullopt);
+
+    void Add(const Document& document);
+
+    void Merge(const TopDocuments& other);
+
+    size_t GetMaxCount() const;
+
+    bool IsFull() const;
+
+    // False if a document of this relevance cannot be kept whatever its rating and id,
+    // so callers can skip looking them up
+    bool CanKeep(double relevance) const;
+
+    // The least relevant document kept, valid only for a non-empty collection
+    const Document& GetWorst() const;
+
+    std::vector<Document> Extract();
+
+private:
+    static constexpr size_t MAX_RESERVED_COUNT = 64;
+
+    size_t max_count_;
+    std::optional<Document> after_;
+    std::vector<Document> heap_;
+};
@@ -0,0 +1,44 @@
+#include "worker_pool.h"
+#include <algorithm>
+
+WorkerPool::WorkerPool(size_t worker_count)
+        : worker_count_(worker_count > 0 ? worker_count : std::max(1u, std::thread::hardware_concurrency())) {
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        is_stopping_ = true;
+    }
+    has_task_.notify_all();
+    for (std::thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+void WorkerPool::StartWorkers() {
+    workers_.reserve(worker_count_);
+    for (size_t i = 0; i < worker_count_; ++i) {
+        workers_.emplace_back([this]() {
+            Run();
+        });
+    }
+}
+
+void WorkerPool::Run() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            has_task_.wait(lock, [this]() {
+                return is_stopping_ || !tasks_.empty();
+            });
+            if (tasks_.empty()) {
+                return;
+            }
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Fixed set of threads running submitted tasks in submission order. Threads start with the first task,
+// so a pool nobody submits to costs nothing. The destructor runs the tasks already queued and joins the threads.
+class WorkerPool {
+public:
+    // 0 takes the number of hardware threads
+    explicit WorkerPool(size_t worker_count = 0);
+
+    WorkerPool(const WorkerPool&) = delete;
+
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    ~WorkerPool();
+
+    // Exceptions thrown by the function come out of the future
+    template <typename Function>
+    std::future<std::invoke_result_t<Function>> Submit(Function function);
+
+private:
+    size_t worker_count_;
+    std::mutex mutex_;
+    std::condition_variable has_task_;
+    std::deque<std::function<void()>> tasks_;
+    std::vector<std::thread> workers_;
+    bool is_stopping_ = false;
+
+    // Called with mutex_ held
+    void StartWorkers();
+
+    void Run();
+};
+
+template <typename Function>
+std::future<std::invoke_result_t<Function>> WorkerPool::Submit(Function function) {
+    // std::function needs a copyable target, the task itself can only be moved
+    auto task = std::make_shared<std::packaged_task<std::invoke_result_t<Function>()>>(std::move(function));
+    std::future<std::invoke_result_t<Function>> result = task->get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (workers_.empty()) {
+            StartWorkers();
+        }
+        tasks_.emplace_back([task]() {
+            (*task)();
+        });
+    }
+    has_task_.notify_one();
+    return result;
+}